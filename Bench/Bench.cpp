@@ -0,0 +1,244 @@
+// Benchmark of the simplification pipeline on deterministic synthetic meshes.
+// Times every phase separately and prints the results as JSON.
+//   SimplifierBench [meshes=sphere,terrain,components] [sizes=10000,100000,1000000]
+//                   [factor=0.1] [threads=0] [out=bench.json]
+#include "Extras.hpp"
+#include "STL.hpp"
+#include "Simplifier.hpp"
+#include "Simplify.hpp"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+struct Params {
+    std::vector<std::string> meshes = {"sphere", "terrain", "components"};
+    std::vector<size_t> sizes = {10000, 100000, 1000000};
+    double factor = 0.1;
+    size_t threads = 0;
+    fs::path outputPath;
+};
+
+std::vector<std::string> Split (std::string const &list) {
+    std::vector<std::string> items;
+    std::istringstream iss (list);
+    for (std::string item; std::getline (iss, item, ',');) {
+        items.push_back (item);
+    }
+    return items;
+}
+
+// Seconds spent in f
+template <typename F>
+double Seconds (F &&f) {
+    auto start = std::chrono::steady_clock::now ();
+    f ();
+    return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+// Geodesic sphere: every icosahedron face split into frequency^2 triangles, projected
+// onto the sphere around center
+void AddSphere (Mesh &mesh, size_t frequency, Vec3 const &center, double radius) {
+    double t = (1 + std::sqrt (5.0)) / 2;
+    double const corners[12][3] = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+    auto corner = [&corners] (int i) { return Vec3 (corners[i][0], corners[i][1], corners[i][2]); };
+    int const faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}};
+
+    double n = static_cast<double> (frequency);
+    for (auto const &f : faces) {
+        Vec3 a = corner (f[0]), b = corner (f[1]), c = corner (f[2]);
+        auto point = [&] (size_t i, size_t j) {
+            Vec3 p = a * ((n - i - j) / n) + b * (i / n) + c * (j / n);
+            return center + p.Normalize () * radius;
+        };
+        for (size_t i = 0; i < frequency; ++i) {
+            for (size_t j = 0; i + j < frequency; ++j) {
+                mesh.emplace_back (point (i, j), point (i + 1, j), point (i, j + 1));
+                if (i + j + 1 < frequency) {
+                    mesh.emplace_back (point (i + 1, j), point (i + 1, j + 1), point (i, j + 1));
+                }
+            }
+        }
+    }
+}
+
+// Value noise in [0, 1) from the grid coordinates
+double Noise (size_t i, size_t j) {
+    double s = std::sin (i * 12.9898 + j * 78.233) * 43758.5453;
+    return s - std::floor (s);
+}
+
+Mesh Sphere (size_t size) {
+    Mesh mesh;
+    AddSphere (mesh, std::max<size_t> (1, static_cast<size_t> (std::sqrt (size / 20.0) + 0.5)), Vec3 (), 1);
+    return mesh;
+}
+
+// Heightfield of rolling hills plus noise over the unit square
+Mesh Terrain (size_t size) {
+    size_t n = std::max<size_t> (2, static_cast<size_t> (std::sqrt (size / 2.0)) + 1);
+    auto point = [n] (size_t i, size_t j) {
+        double x = static_cast<double> (i) / (n - 1), y = static_cast<double> (j) / (n - 1);
+        double z = 0.1 * std::sin (6 * x) * std::cos (4 * y) + 0.01 * Noise (i, j);
+        return Vec3 (x, y, z);
+    };
+    Mesh mesh;
+    mesh.reserve (2 * (n - 1) * (n - 1));
+    for (size_t i = 0; i + 1 < n; ++i) {
+        for (size_t j = 0; j + 1 < n; ++j) {
+            mesh.emplace_back (point (i, j), point (i + 1, j), point (i + 1, j + 1));
+            mesh.emplace_back (point (i, j), point (i + 1, j + 1), point (i, j + 1));
+        }
+    }
+    return mesh;
+}
+
+// Small spheres of 80 triangles on a jittered lattice
+Mesh Components (size_t size) {
+    size_t count = std::max<size_t> (1, size / 80);
+    size_t side = static_cast<size_t> (std::ceil (std::cbrt (static_cast<double> (count))));
+    Mesh mesh;
+    mesh.reserve (80 * count);
+    for (size_t k = 0; k < count; ++k) {
+        size_t x = k % side, y = k / side % side, z = k / (side * side);
+        Vec3 center (x + 0.2 * Noise (k, 1), y + 0.2 * Noise (k, 2), z + 0.2 * Noise (k, 3));
+        AddSphere (mesh, 2, center, 0.2 + 0.1 * Noise (k, 4));
+    }
+    return mesh;
+}
+
+struct Result {
+    std::string mesh;
+    size_t faces = 0;
+    size_t outputFaces = 0;
+    double quadricError = 0;
+    size_t arenaPeakBytes = 0;
+    size_t structureBytes = 0; // MemoryUsage of the Simplifier after the collapse
+    std::vector<std::pair<std::string, double>> phases;
+};
+
+Result Run (std::string const &name, size_t size, Params const &params) {
+    Result result;
+    result.mesh = name;
+    auto phase = [&result] (std::string const &phaseName, auto &&f) {
+        result.phases.push_back ({phaseName, Seconds (f)});
+    };
+
+    Mesh mesh;
+    phase ("generate", [&] () {
+        mesh = name == "sphere" ? Sphere (size) : name == "terrain" ? Terrain (size) : Components (size);
+    });
+    result.faces = mesh.size ();
+
+    fs::path path = fs::temp_directory_path () / ("SimplifierBench_" + name + ".stl");
+    phase ("save", [&] () { STL::SaveBinary (path, mesh, params.threads); });
+    phase ("load", [&] () { mesh = STL::Load (path, params.threads); });
+    fs::remove (path);
+
+    // The setup stages alone, then the whole Simplifier on the same input
+    SimplifyOptions options;
+    options.threads = params.threads;
+    {
+        ThreadPool pool (params.threads);
+        IndexedMesh indexed;
+        std::pmr::vector<uint32_t> indices (indexed.Resource ());
+        phase ("weld", [&] () { CreateVertices (mesh, options.weldTolerance, {}, indices, indexed); });
+        phase ("faces", [&] () { CreateFacesAndMapVertices (indices, indexed); });
+        phase ("quadrics", [&] () { CreateQuadrics (indexed, pool); });
+        phase ("edges", [&] () { CreateEdges (indexed, pool); });
+    }
+
+    std::unique_ptr<Simplifier> simplifier;
+    Mesh output;
+    phase ("setup", [&] () { simplifier = std::make_unique<Simplifier> (mesh, options); });
+    phase ("collapse", [&] () { simplifier->Run (static_cast<size_t> (mesh.size () * params.factor)); });
+    phase ("construct", [&] () { output = simplifier->Result (); });
+
+    SimplifyStats stats = simplifier->Stats ();
+    result.outputFaces = output.size ();
+    result.quadricError = stats.quadricError;
+    result.arenaPeakBytes = stats.arena.peakBytes;
+    result.structureBytes = stats.memory.Total ();
+    return result;
+}
+
+std::string ToJson (std::vector<Result> const &results, Params const &params) {
+    std::ostringstream json;
+    json.precision (9);
+    json << "{\n  \"factor\": " << params.factor << ",\n  \"threads\": " << params.threads << ",\n  \"runs\": [";
+    for (size_t r = 0; r < results.size (); ++r) {
+        Result const &result = results[r];
+        json << (r ? "," : "") << "\n    {\"mesh\": \"" << result.mesh << "\", \"faces\": " << result.faces
+             << ", \"outputFaces\": " << result.outputFaces << ", \"quadricError\": " << result.quadricError
+             << ", \"arenaPeakBytes\": " << result.arenaPeakBytes << ", \"structureBytes\": " << result.structureBytes
+             << ",\n     \"phases\": {";
+        for (size_t p = 0; p < result.phases.size (); ++p) {
+            double seconds = result.phases[p].second;
+            json << (p ? ", " : "") << "\"" << result.phases[p].first << "\": {\"seconds\": " << seconds
+                 << ", \"trianglesPerSecond\": " << (seconds > 0 ? result.faces / seconds : 0) << "}";
+        }
+        json << "}}";
+    }
+    // The process peak never goes down, it covers every run before it and is reported once
+    json << "\n  ],\n  \"peakMemoryBytes\": " << PeakMemoryBytes () << "\n}\n";
+    return json.str ();
+}
+}
+
+int main (int argc, char *argv[]) {
+    Params params;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.find ("meshes=") == 0) {
+            params.meshes = Split (arg.substr (7));
+        } else if (arg.find ("sizes=") == 0) {
+            params.sizes.clear ();
+            for (std::string const &size : Split (arg.substr (6))) {
+                params.sizes.push_back (std::stoull (size));
+            }
+        } else if (arg.find ("factor=") == 0) {
+            params.factor = std::stod (arg.substr (7));
+        } else if (arg.find ("threads=") == 0) {
+            params.threads = std::stoi (arg.substr (8));
+        } else if (arg.find ("out=") == 0) {
+            params.outputPath = arg.substr (4);
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    for (std::string const &mesh : params.meshes) {
+        if (mesh != "sphere" && mesh != "terrain" && mesh != "components") {
+            std::cerr << "Unknown mesh: " << mesh << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    for (std::string const &mesh : params.meshes) {
+        for (size_t size : params.sizes) {
+            std::cerr << "Running " << mesh << " " << size << std::endl;
+            results.push_back (Run (mesh, size, params));
+        }
+    }
+
+    std::string json = ToJson (results, params);
+    if (params.outputPath.empty ()) {
+        std::cout << json;
+    } else {
+        std::ofstream (params.outputPath) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#include "Arena.hpp"
+#include <algorithm>
+
+CountingResource::CountingResource (std::pmr::memory_resource *upstream) : upstream (upstream) {}
+
+void *CountingResource::do_allocate (size_t size, size_t alignment) {
+    void *p = upstream->allocate (size, alignment);
+    allocations++;
+    bytes += size;
+    peakBytes = std::max (peakBytes, bytes);
+    return p;
+}
+
+void CountingResource::do_deallocate (void *p, size_t size, size_t alignment) {
+    upstream->deallocate (p, size, alignment);
+    bytes -= size;
+}
+
+bool CountingResource::do_is_equal (std::pmr::memory_resource const &other) const noexcept {
+    return this == &other;
+}
+
+namespace {
+// Adjacency lists and per-collapse lists stay well below this, the bulk arrays go straight to the system
+constexpr size_t LARGEST_POOLED_BLOCK = 64 * 1024;
+}
+
+Arena::Arena ()
+    : system (std::pmr::new_delete_resource ()),
+      pool (std::pmr::pool_options{0, LARGEST_POOLED_BLOCK}, &system),
+      requests (&pool) {}
+
+ArenaStats Arena::Stats () const {
+    ArenaStats stats;
+    stats.allocations = requests.allocations;
+    stats.systemAllocations = system.allocations;
+    stats.peakBytes = system.peakBytes;
+    return stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+struct ArenaStats {
+    size_t allocations = 0;       // requests served by the arena
+    size_t systemAllocations = 0; // blocks taken from the system heap
+    size_t peakBytes = 0;         // peak bytes held from the system heap
+};
+
+// Forwards to an upstream resource and counts the traffic
+class CountingResource : public std::pmr::memory_resource {
+  public:
+    explicit CountingResource (std::pmr::memory_resource *upstream);
+
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+
+  private:
+    std::pmr::memory_resource *upstream;
+
+    void *do_allocate (size_t size, size_t alignment) override;
+    void do_deallocate (void *p, size_t size, size_t alignment) override;
+    bool do_is_equal (std::pmr::memory_resource const &other) const noexcept override;
+};
+
+// Pool allocator for the working state of one Simplify () call.
+// Freed blocks are recycled by size class, the whole pool goes back
+// to the system in one release when the arena is destroyed.
+class Arena {
+  public:
+    Arena ();
+    Arena (Arena const &) = delete;
+    Arena &operator= (Arena const &) = delete;
+
+    std::pmr::memory_resource *Resource () { return &requests; }
+    ArenaStats Stats () const;
+
+  private:
+    CountingResource system;
+    std::pmr::unsynchronized_pool_resource pool;
+    CountingResource requests;
+};
@@ -0,0 +1,185 @@
+#include "Batch.hpp"
+#include "Extras.hpp"
+#include "STL.hpp"
+#include "Simplify.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+// Fewest bytes an ASCII facet takes, overestimates the faces of an ASCII file
+constexpr size_t ASCII_BYTES_PER_FACE = 128;
+
+// Face count from the header of a binary STL, or a bound from the size of an ASCII one
+size_t EstimateFaces (fs::path const &path) {
+    size_t size = fs::file_size (path);
+    if (size >= 84) {
+        std::ifstream file (path, std::ios::binary);
+        uint32_t count = 0;
+        file.seekg (80);
+        file.read (reinterpret_cast<char *> (&count), sizeof (count));
+        if (file && 84 + 50 * size_t{count} == size) {
+            return count;
+        }
+    }
+    return size / ASCII_BYTES_PER_FACE;
+}
+
+struct Loaded {
+    size_t file;
+    size_t bytes;
+    Mesh mesh;
+};
+}
+
+std::vector<fs::path> BatchInputs (fs::path const &input) {
+    std::vector<fs::path> inputs;
+    if (fs::is_directory (input)) {
+        for (fs::directory_entry const &entry : fs::directory_iterator (input)) {
+            std::string extension = entry.path ().extension ().string ();
+            std::transform (extension.begin (), extension.end (), extension.begin (), [] (unsigned char c) { return std::tolower (c); });
+            if (entry.is_regular_file () && extension == ".stl") {
+                inputs.push_back (entry.path ());
+            }
+        }
+        std::sort (inputs.begin (), inputs.end ());
+        return inputs;
+    }
+
+    std::ifstream manifest (input);
+    if (!manifest.is_open ()) {
+        throw std::runtime_error ("Cannot open manifest " + input.string ());
+    }
+    std::string line;
+    while (std::getline (manifest, line)) {
+        line.erase (line.find_last_not_of (" \t\r") + 1);
+        line.erase (0, line.find_first_not_of (" \t"));
+        if (line.empty () || line[0] == '#') {
+            continue;
+        }
+        fs::path path (line);
+        inputs.push_back (path.is_absolute () ? path : input.parent_path () / path);
+    }
+    return inputs;
+}
+
+void SimplifyBatch (std::vector<BatchFile> &files, size_t jobs, size_t memoryBudget, std::function<Mesh (Mesh const &)> const &simplify) {
+    jobs = std::max<size_t> (1, jobs);
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Loaded> ready;
+    size_t held = 0;
+    bool loaded = false;
+
+    auto release = [&] (size_t bytes) {
+        std::lock_guard<std::mutex> lock (mutex);
+        held -= bytes;
+        changed.notify_all ();
+    };
+
+    // Keeps at most `jobs` meshes waiting, a file too large for what is left waits for the running ones
+    std::thread loader ([&] () {
+        for (size_t i = 0; i < files.size (); ++i) {
+            BatchFile &file = files[i];
+            size_t bytes = 0;
+            try {
+                size_t faces = EstimateFaces (file.input);
+                bytes = faces * WORKING_BYTES_PER_FACE;
+                CheckMemoryLimit (bytes, memoryBudget, "Simplifying " + std::to_string (faces) + " faces");
+            } catch (std::exception const &e) {
+                file.error = e.what ();
+                continue;
+            }
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                changed.wait (lock, [&] () {
+                    return ready.size () < jobs && (held == 0 || memoryBudget == 0 || held + bytes <= memoryBudget);
+                });
+                held += bytes;
+            }
+
+            Mesh mesh;
+            try {
+                Trace::Scope trace ("Load");
+                file.loadMs = TimeIt ([&file, &mesh] () { mesh = STL::Load (file.input); });
+                file.inputFaces = mesh.size ();
+            } catch (std::exception const &e) {
+                file.error = e.what ();
+                release (bytes);
+                continue;
+            }
+            std::lock_guard<std::mutex> lock (mutex);
+            ready.push_back ({i, bytes, std::move (mesh)});
+            changed.notify_all ();
+        }
+        std::lock_guard<std::mutex> lock (mutex);
+        loaded = true;
+        changed.notify_all ();
+    });
+
+    auto work = [&] () {
+        while (true) {
+            Loaded job;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                changed.wait (lock, [&] () { return !ready.empty () || loaded; });
+                if (ready.empty ()) {
+                    return;
+                }
+                job = std::move (ready.front ());
+                ready.pop_front ();
+                changed.notify_all ();
+            }
+
+            BatchFile &file = files[job.file];
+            try {
+                Mesh result;
+                file.simplifyMs = TimeIt ([&] () {
+                    Trace::Scope trace ("Simplify");
+                    result = simplify (job.mesh);
+                });
+                Mesh ().swap (job.mesh);
+                file.outputFaces = result.size ();
+                file.saveMs = TimeIt ([&] () {
+                    Trace::Scope trace ("Save");
+                    STL::SaveBinary (file.output, result);
+                });
+            } catch (std::exception const &e) {
+                file.error = e.what ();
+            }
+            Mesh ().swap (job.mesh);
+            release (job.bytes);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t j = 0; j < jobs; ++j) {
+        workers.emplace_back (work);
+    }
+    loader.join ();
+    for (std::thread &worker : workers) {
+        worker.join ();
+    }
+}
+
+void SaveBatchReport (fs::path const &path, std::vector<BatchFile> const &files) {
+    std::ofstream report (path);
+    if (!report.is_open ()) {
+        throw std::runtime_error ("Cannot create report file " + path.string ());
+    }
+    report << "input,output,input faces,output faces,load ms,simplify ms,save ms,error\n";
+    for (BatchFile const &file : files) {
+        std::string error = file.error;
+        std::replace (error.begin (), error.end (), '"', '\'');
+        report << '"' << file.input.string () << "\",\"" << file.output.string () << "\"," << file.inputFaces << ',' << file.outputFaces << ','
+               << file.loadMs << ',' << file.simplifyMs << ',' << file.saveMs << ",\"" << error << "\"\n";
+    }
+    if (!report) {
+        throw std::runtime_error ("Error writing " + path.string ());
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "Geometry.hpp"
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// One file of a batch and what became of it
+struct BatchFile {
+    fs::path input;
+    fs::path output;
+    size_t inputFaces = 0;
+    size_t outputFaces = 0;
+    long long loadMs = 0;
+    long long simplifyMs = 0;
+    long long saveMs = 0;
+    std::string error; // empty when the file went through
+};
+
+// The STL files of a directory, or the paths listed in a manifest, one per line, relative to the manifest
+std::vector<fs::path> BatchInputs (fs::path const &input);
+
+// Load, simplify and save every file, up to `jobs` simplifications at once. A loader thread reads the
+// next files ahead while memory allows: each file holds its estimated working memory from load to
+// save, and the files held at once stay within memoryBudget bytes (0 = unlimited).
+// A file that fails records its error, the batch goes on.
+void SimplifyBatch (std::vector<BatchFile> &files, size_t jobs, size_t memoryBudget, std::function<Mesh (Mesh const &)> const &simplify);
+
+// One CSV line per file
+void SaveBatchReport (fs::path const &path, std::vector<BatchFile> const &files);
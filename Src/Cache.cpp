@@ -0,0 +1,129 @@
+#include "Cache.hpp"
+#include "Simplifier.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+// Triangles per hashed chunk, fixed so the hash does not depend on the thread count
+constexpr size_t HASH_CHUNK = size_t{1} << 16;
+// Changes whenever the collapse sequence of a mesh does, so older entries miss
+constexpr uint64_t SEQUENCE_VERSION = 1;
+
+uint64_t Mix (uint64_t h, uint64_t value) {
+    h = (h ^ value) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 29);
+}
+
+// splitmix64 finalizer, spreads the last words over all bits
+uint64_t Finish (uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+uint64_t Bits (double value) {
+    uint64_t bits;
+    std::memcpy (&bits, &value, sizeof (bits));
+    return bits;
+}
+
+[[maybe_unused]] uint64_t Bits (float value) {
+    uint32_t bits;
+    std::memcpy (&bits, &value, sizeof (bits));
+    return bits;
+}
+}
+
+uint64_t MeshHash (Mesh const &mesh, size_t threads) {
+    Trace::Scope trace ("MeshHash");
+    std::vector<uint64_t> chunks ((mesh.size () + HASH_CHUNK - 1) / HASH_CHUNK);
+    ThreadPool pool (threads);
+    pool.ParallelFor (chunks.size (), [&mesh, &chunks] (size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            uint64_t h = c;
+            size_t last = std::min (mesh.size (), (c + 1) * HASH_CHUNK);
+            for (size_t i = c * HASH_CHUNK; i < last; ++i) {
+                for (Vec3 const &v : {mesh[i].v1, mesh[i].v2, mesh[i].v3}) {
+                    h = Mix (Mix (Mix (h, Bits (v.x)), Bits (v.y)), Bits (v.z));
+                }
+            }
+            chunks[c] = h;
+        }
+    }, 1);
+
+    uint64_t h = mesh.size ();
+    for (uint64_t chunk : chunks) {
+        h = Mix (h, chunk);
+    }
+    return Finish (h);
+}
+
+Mesh SimplifyCached (Mesh const &input, double factor, fs::path const &directory, SimplifyOptions const &options,
+                     SimplifyStats *stats, bool *hit) {
+    Trace::Scope trace ("SimplifyCached");
+    // Welding and the precision of Real change the sequence, threads and memory limits do not
+    uint64_t key = Finish (Mix (Mix (Mix (MeshHash (input, options.threads), Bits (options.weldTolerance)), sizeof (Real)), SEQUENCE_VERSION));
+    std::ostringstream name;
+    name << std::hex << std::setw (16) << std::setfill ('0') << key << ".pm";
+    fs::path path = directory / name.str ();
+    size_t target = static_cast<size_t> (input.size () * factor);
+
+    if (fs::exists (path)) {
+        try {
+            Trace::Scope replay ("Replay");
+            // Simplify () stops at the first collapse that reaches target, refine up to the last split before it
+            Progressive::Reader reader (path);
+            while (reader.NextFaceCount () <= target && reader.Refine ()) {
+            }
+            Mesh result = reader.Extract ();
+            if (stats) {
+                *stats = SimplifyStats ();
+                stats->replayed = true;
+            }
+            if (hit) {
+                *hit = true;
+            }
+            return result;
+        } catch (std::exception const &) {
+            // Truncated or foreign entry, simplify again and replace it
+        }
+    }
+    if (hit) {
+        *hit = false;
+    }
+
+    Simplifier simplifier (input, options);
+    simplifier.Record ();
+    simplifier.Run (target);
+    Mesh result = simplifier.Result ();
+    if (stats) {
+        *stats = simplifier.Stats ();
+    }
+    simplifier.Run (0);
+
+    // Concurrent misses of one mesh each write their own file and rename it into place. Where rename
+    // does not replace an existing file (Windows), the old entry is removed first: it is either the
+    // same sequence from another writer or an unreadable one. Losing that race leaves the winner's.
+    fs::create_directories (directory);
+    fs::path temporary = path;
+    temporary += "." + std::to_string (std::hash<std::thread::id> () (std::this_thread::get_id ()) ^
+                                       static_cast<size_t> (std::chrono::steady_clock::now ().time_since_epoch ().count ())) + ".tmp";
+    simplifier.SaveProgressive (temporary);
+    std::error_code error;
+    fs::rename (temporary, path, error);
+    if (error) {
+        fs::remove (path, error);
+        fs::rename (temporary, path, error);
+    }
+    if (error) {
+        fs::remove (temporary, error);
+    }
+    return result;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "Simplify.hpp"
+#include <cstdint>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Hash of the triangle coordinates, independent of the thread count
+uint64_t MeshHash (Mesh const &mesh, size_t threads = 1);
+
+// Simplify () through a directory of collapse sequences. The whole greedy sequence of a mesh is
+// kept as a progressive mesh, named by the hash of the mesh and of the options that shape it.
+// A hit replays the sequence up to factor: it refines the stored base mesh to the faces Simplify ()
+// stops at, with positions at float precision. A miss simplifies to factor, then continues to the
+// end of the sequence and stores it. An unreadable entry counts as a miss and is replaced.
+// An entry that cannot be stored leaves the cache as it was, the result is returned anyway.
+Mesh SimplifyCached (Mesh const &input, double factor, fs::path const &directory, SimplifyOptions const &options = {},
+                     SimplifyStats *stats = nullptr, bool *hit = nullptr);
@@ -0,0 +1,243 @@
+#include "Cluster.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace {
+// Faces sampled per step of the resolution search
+constexpr size_t SEARCH_SAMPLES = 1 << 16;
+// Cells per axis are packed into 21 bits of a cell key
+constexpr uint64_t MAX_RESOLUTION = 1 << 20;
+
+class ClusterGrid {
+  public:
+    ClusterGrid (Vec3 const &lo, double size, uint64_t resolution)
+        : lo (lo), cellSize (size / resolution), resolution (resolution) {}
+
+    uint64_t Key (Vec3 const &v) const {
+        Vec3 p = v - lo;
+        return (Index (p.x) << 42) | (Index (p.y) << 21) | Index (p.z);
+    }
+
+    // Whether v lies in the cell of key, grown by half a cell on every side
+    bool Near (uint64_t key, Vec3 const &v) const {
+        Vec3 p = v - lo;
+        uint64_t const index[3] = {key >> 42, (key >> 21) & (MAX_RESOLUTION * 2 - 1), key & (MAX_RESOLUTION * 2 - 1)};
+        double const coords[3] = {p.x, p.y, p.z};
+        for (size_t axis = 0; axis < 3; ++axis) {
+            double offset = coords[axis] / cellSize - static_cast<double> (index[axis]);
+            if (offset < -0.5 || offset > 1.5) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+  private:
+    Vec3 lo;
+    double cellSize;
+    uint64_t resolution;
+
+    uint64_t Index (double c) const {
+        return std::min (static_cast<uint64_t> (std::max (0.0, c / cellSize)), resolution - 1);
+    }
+};
+
+// Cell key to cluster index, open addressing
+class ClusterTable {
+  public:
+    explicit ClusterTable (size_t expected) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected) {
+            capacity *= 2;
+        }
+        keys.assign (capacity, EMPTY);
+        clusters.resize (capacity);
+    }
+
+    size_t Size () const { return count; }
+
+    uint32_t Find (uint64_t key) {
+        if (2 * (count + 1) > keys.size ()) {
+            Grow ();
+        }
+        size_t slot = Slot (key);
+        while (keys[slot] != EMPTY && keys[slot] != key) {
+            slot = (slot + 1) & (keys.size () - 1);
+        }
+        if (keys[slot] == EMPTY) {
+            keys[slot] = key;
+            clusters[slot] = static_cast<uint32_t> (count++);
+        }
+        return clusters[slot];
+    }
+
+  private:
+    static constexpr uint64_t EMPTY = UINT64_MAX;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> clusters;
+    size_t count = 0;
+
+    size_t Slot (uint64_t key) const {
+        return (key * 0x9E3779B97F4A7C15ull >> 20) & (keys.size () - 1);
+    }
+
+    void Grow () {
+        std::vector<uint64_t> previousKeys = std::move (keys);
+        std::vector<uint32_t> previousClusters = std::move (clusters);
+        keys.assign (2 * previousKeys.size (), EMPTY);
+        clusters.assign (2 * previousKeys.size (), 0);
+        for (size_t i = 0; i < previousKeys.size (); ++i) {
+            if (previousKeys[i] != EMPTY) {
+                size_t slot = Slot (previousKeys[i]);
+                while (keys[slot] != EMPTY) {
+                    slot = (slot + 1) & (keys.size () - 1);
+                }
+                keys[slot] = previousKeys[i];
+                clusters[slot] = previousClusters[i];
+            }
+        }
+    }
+};
+
+struct TriangleKey {
+    uint32_t a, b, c;
+
+    bool operator== (TriangleKey const &other) const {
+        return a == other.a && b == other.b && c == other.c;
+    }
+};
+
+struct TriangleKeyHash {
+    size_t operator() (TriangleKey const &k) const {
+        return (k.a * 0x9E3779B97F4A7C15ull) ^ (k.b * 0xC2B2AE3D27D4EB4Full) ^ (k.c * 0x165667B19E3779F9ull);
+    }
+};
+
+// Same triangle, same winding: rotate the smallest index first
+TriangleKey Canonical (uint32_t a, uint32_t b, uint32_t c) {
+    if (b < a && b < c) {
+        return {b, c, a};
+    }
+    if (c < a && c < b) {
+        return {c, a, b};
+    }
+    return {a, b, c};
+}
+}
+
+Mesh SimplifyClustered (Mesh const &input, double factor, SimplifyOptions const &options, SimplifyStats *stats) {
+    Trace::Scope trace ("SimplifyClustered");
+    if (input.empty ()) {
+        return {};
+    }
+    ThreadPool pool (options.threads);
+
+    Vec3 lo = input[0].v1, hi = lo;
+    for (Triangle const &t : input) {
+        for (Vec3 const &v : {t.v1, t.v2, t.v3}) {
+            lo = Vec3 (std::min (lo.x, v.x), std::min (lo.y, v.y), std::min (lo.z, v.z));
+            hi = Vec3 (std::max (hi.x, v.x), std::max (hi.y, v.y), std::max (hi.z, v.z));
+        }
+    }
+    Vec3 extent = hi - lo;
+    double size = std::max<double> ({extent.x, extent.y, extent.z, EPSILON});
+
+    // Largest resolution whose sampled faces survive at most at the target rate
+    size_t step = std::max<size_t> (1, input.size () / SEARCH_SAMPLES);
+    auto survivors = [&input, &lo, size, step] (uint64_t resolution) {
+        ClusterGrid grid (lo, size, resolution);
+        size_t count = 0;
+        for (size_t i = 0; i < input.size (); i += step) {
+            uint64_t a = grid.Key (input[i].v1), b = grid.Key (input[i].v2), c = grid.Key (input[i].v3);
+            count += a != b && a != c && b != c;
+        }
+        return static_cast<double> (count) * step;
+    };
+    double target = input.size () * factor;
+    uint64_t low = 1, high = MAX_RESOLUTION;
+    while (low < high) {
+        uint64_t middle = (low + high + 1) / 2;
+        if (survivors (middle) <= target) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    ClusterGrid grid (lo, size, low);
+
+    // Cell keys and face quadrics in parallel, then one serial pass assigns the clusters
+    std::vector<uint64_t> keys (3 * input.size ());
+    std::vector<Quadric> quadrics (input.size ());
+    pool.ParallelFor (input.size (), [&input, &grid, &keys, &quadrics] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            keys[3 * i] = grid.Key (input[i].v1);
+            keys[3 * i + 1] = grid.Key (input[i].v2);
+            keys[3 * i + 2] = grid.Key (input[i].v3);
+            quadrics[i] = input[i].Quadric ();
+        }
+    });
+
+    ClusterTable table (static_cast<size_t> (target));
+    std::vector<uint32_t> corners (keys.size ());
+    std::vector<Quadric> clusterQuadrics;
+    std::vector<Vec3> sums;
+    std::vector<uint32_t> counts;
+    std::vector<uint64_t> clusterKeys;
+    for (size_t i = 0; i < keys.size (); ++i) {
+        uint32_t c = table.Find (keys[i]);
+        if (c == clusterQuadrics.size ()) {
+            clusterQuadrics.emplace_back ();
+            sums.emplace_back ();
+            counts.push_back (0);
+            clusterKeys.push_back (keys[i]);
+        }
+        corners[i] = c;
+        Triangle const &t = input[i / 3];
+        clusterQuadrics[c] += quadrics[i / 3];
+        sums[c] = sums[c] + (i % 3 == 0 ? t.v1 : i % 3 == 1 ? t.v2 : t.v3);
+        counts[c]++;
+    }
+    std::vector<uint64_t> ().swap (keys);
+    std::vector<Quadric> ().swap (quadrics);
+
+    // Quadric-optimal representatives, the mean of the cluster when the quadric is
+    // singular or its optimum leaves the neighborhood of the cell
+    std::vector<Vec3> positions (clusterQuadrics.size ());
+    pool.ParallelFor (positions.size (), [&] (size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            Vec3 mean = sums[c] * (1.0 / counts[c]);
+            positions[c] = mean;
+            Vec3 v;
+            if (clusterQuadrics[c].Optimum (v) && grid.Near (clusterKeys[c], v)) {
+                positions[c] = v;
+            }
+        }
+    });
+
+    // Drop triangles collapsed within a cluster and duplicates of kept ones
+    Mesh result;
+    result.reserve (static_cast<size_t> (target));
+    std::unordered_set<TriangleKey, TriangleKeyHash> kept;
+    kept.reserve (static_cast<size_t> (target));
+    std::vector<uint8_t> used (positions.size (), 0);
+    for (size_t i = 0; i < corners.size (); i += 3) {
+        uint32_t a = corners[i], b = corners[i + 1], c = corners[i + 2];
+        if (a == b || a == c || b == c || !kept.insert (Canonical (a, b, c)).second) {
+            continue;
+        }
+        result.emplace_back (positions[a], positions[b], positions[c]);
+        used[a] = used[b] = used[c] = 1;
+    }
+
+    if (stats) {
+        *stats = SimplifyStats ();
+        for (size_t c = 0; c < positions.size (); ++c) {
+            if (used[c]) {
+                stats->quadricError += clusterQuadrics[c].Error (positions[c]);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "Simplify.hpp"
+
+// Vertex clustering: the vertexes are snapped to a uniform grid, every occupied cell
+// becomes one vertex at the quadric-optimal position of its faces and triangles
+// collapsed within a cell are dropped. The grid resolution is searched on a sample of
+// the faces to land near input * factor faces. Far faster than edge collapse, for
+// preview quality levels of detail.
+Mesh SimplifyClustered (Mesh const &input, double factor, SimplifyOptions const &options = {}, SimplifyStats *stats = nullptr);
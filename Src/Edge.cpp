@@ -1,72 +1,50 @@
 #include "Edge.hpp"
 
-bool EdgeComparator::operator() (const Edge *a, const Edge *b) const {
-    return a->Error () > b->Error ();
-}
-
-bool EdgeComparator::operator() (const Edge &a, const Edge &b) const {
-    return a.Error () > b.Error ();
-}
-
-PairKey MakePairKey (Vertex const *a, Vertex const *b) {
-    if (b->v < a->v) {
-        std::swap (a, b);
-    }
-    return std::pair<Vec3, Vec3> (a->v, b->v);
-}
+Edge::Edge () : A (0), B (0), Removed (false), CachedError (-1) {}
 
-Edge::Edge () : A (nullptr), B (nullptr), Removed (false), CachedError (-1) {}
-
-Edge::Edge (Vertex const *a, Vertex const *b)
+Edge::Edge (uint32_t a, uint32_t b)
     : A (a), B (b), Removed (false), CachedError (-1) {
-    if (b->v < a->v) {
+    if (b < a) {
         std::swap (A, B);
     }
 }
+
 bool Edge::operator== (const Edge &other) const {
     return A == other.A && B == other.B;
 }
 
-Matrix Edge::Quadric () const {
-    return A->q + B->q;
+Quadric Edge::Quadric (std::pmr::vector<Vertex> const &vertices) const {
+    return vertices[A].q + vertices[B].q;
 }
 
-std::unique_ptr<Vertex> Edge::ComputeNewVertex () const {
-    return std::make_unique<Vertex> (ComputeNewVector (), Quadric ());
+Vertex Edge::ComputeNewVertex (std::pmr::vector<Vertex> const &vertices) const {
+    return Vertex (CachedVector, Quadric (vertices));
 }
 
-Vec3 Edge::ComputeNewVector () const {
-    Matrix q = Quadric ();
-    if (std::abs (q.Determinant ()) > EPSILON) {
-        Vec3 v = q.QuadricVector ();
-        if (!std::isnan (v.x) && !std::isnan (v.y) && !std::isnan (v.z)) {
-            return v;
-        }
+Vec3 Edge::ComputeNewVector (::Quadric const &q, std::pmr::vector<Vertex> const &vertices) const {
+    Vec3 v;
+    if (q.Optimum (v)) {
+        return v;
     }
-    // Cannot compute best vector with matrix
-    // Look for best vector along edge
-    Vec3 a = A->v;
-    Vec3 b = B->v;
-    Vec3 d = b - a;
-
-    static constexpr size_t N = 32;
-    double bestE = -1.0;
-    Vec3 bestV;
-    for (size_t i = 0; i <= N; ++i) {
-        double t = static_cast<double> (i) / N;
-        Vec3 v = a + (d * t);
-        double e = q.QuadricError (v);
-        if (bestE < 0 || e < bestE) {
+    // Cannot solve for the best vector, take the best of the endpoints and the midpoint
+    Vec3 a = vertices[A].v;
+    Vec3 b = vertices[B].v;
+    Vec3 best = (a + b) * 0.5;
+    double bestE = q.Error (best);
+    for (Vec3 const &c : {a, b}) {
+        double e = q.Error (c);
+        if (e < bestE) {
             bestE = e;
-            bestV = v;
+            best = c;
         }
     }
-    return bestV;
+    return best;
 }
 
-double Edge::Error () const {
-    if (CachedError < 0) {
-        CachedError = Quadric ().QuadricError (ComputeNewVector ());
-    }
+// Recompute the collapse candidate after the quadric of an endpoint changed
+double Edge::UpdateError (std::pmr::vector<Vertex> const &vertices) {
+    ::Quadric q = Quadric (vertices);
+    CachedVector = ComputeNewVector (q, vertices);
+    CachedError = q.Error (CachedVector);
     return CachedError;
-}
\ No newline at end of file
+}
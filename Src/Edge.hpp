@@ -2,40 +2,26 @@
 
 #include "Geometry.hpp"
 #include <cmath>
-#include <memory>
+#include <cstdint>
 #include <utility>
+#include <vector>
 
-using PairKey = std::pair<Vec3, Vec3>;
-
-PairKey MakePairKey (Vertex const *a, Vertex const *b);
-
+// Collapsible vertex pair of the indexed working mesh, A < B
 class Edge {
   public:
-    Vertex const *A;
-    Vertex const *B;
-    mutable bool Removed;
-    mutable double CachedError;
+    uint32_t A;
+    uint32_t B;
+    bool Removed;
+    // Collapse candidate: cost and position of the merged vertex as of the last UpdateError
+    double CachedError;
+    Vec3 CachedVector;
 
     Edge ();
-    Edge (Vertex const *a, Vertex const *b);
+    Edge (uint32_t a, uint32_t b);
     bool operator== (const Edge &other) const;
-    Matrix Quadric () const;
-    std::unique_ptr<Vertex> ComputeNewVertex () const;
-    Vec3 ComputeNewVector () const;
-    double Error () const;
+    ::Quadric Quadric (std::pmr::vector<Vertex> const &vertices) const;
+    // Merged vertex of the cached candidate
+    Vertex ComputeNewVertex (std::pmr::vector<Vertex> const &vertices) const;
+    Vec3 ComputeNewVector (::Quadric const &q, std::pmr::vector<Vertex> const &vertices) const;
+    double UpdateError (std::pmr::vector<Vertex> const &vertices);
 };
-
-// for unordered_set
-template <>
-struct std::hash<Edge> {
-    std::size_t operator() (const Edge &s) const noexcept {
-        std::size_t h1 = std::hash<Vertex const *>{}(s.A);
-        std::size_t h2 = std::hash<Vertex const *>{}(s.B);
-        return h1 ^ (h2 << 1);
-    }
-};
-
-struct EdgeComparator {
-    bool operator() (Edge const &a, Edge const &b) const;
-    bool operator() (const Edge *a, const Edge *b) const;
-};
\ No newline at end of file
@@ -1,5 +1,14 @@
 #include "Extras.hpp"
 #include <chrono>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#endif
 
 long long TimeIt (std::function<void ()> const &func) {
     using namespace std::chrono;
@@ -7,4 +16,32 @@ long long TimeIt (std::function<void ()> const &func) {
     func ();
     auto stop = high_resolution_clock::now ();
     return duration_cast<milliseconds> (stop - start).count ();
-}
\ No newline at end of file
+}
+
+size_t PeakMemoryBytes () {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof (counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+#else
+    std::ifstream status ("/proc/self/status");
+    for (std::string line; std::getline (status, line);) {
+        if (line.find ("VmHWM:") == 0) {
+            return std::stoull (line.substr (6)) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+MeshQuality MeasureQuality (Mesh const &mesh) {
+    MeshQuality quality;
+    quality.faces = mesh.size ();
+    for (Triangle const &t : mesh) {
+        Vec3 cross = (t.v2 - t.v1).Cross (t.v3 - t.v1);
+        quality.area += 0.5 * cross.Length ();
+        quality.volume += t.v1.Dot (t.v2.Cross (t.v3)) / 6.0;
+    }
+    return quality;
+}
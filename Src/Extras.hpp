@@ -1,5 +1,17 @@
 #pragma once
+#include "Geometry.hpp"
 #include <functional>
 
 // measure time of function f in milliseconds
-long long TimeIt (std::function<void ()> const &f);
\ No newline at end of file
+long long TimeIt (std::function<void ()> const &f);
+
+// peak resident memory of the process in bytes, 0 where the platform does not tell
+size_t PeakMemoryBytes ();
+
+// Surface area and enclosed volume, to compare results of different builds or engines
+struct MeshQuality {
+    size_t faces = 0;
+    double area = 0;
+    double volume = 0;
+};
+MeshQuality MeasureQuality (Mesh const &mesh);
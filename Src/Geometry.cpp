@@ -1,14 +1,25 @@
 #include "Geometry.hpp"
+#include <algorithm>
 #include <cmath>
+#include <limits>
+
+namespace {
+// Coordinates within EPSILON are equal. Where a few units in the last place of Real are
+// more, e.g. float coordinates beyond about 100, those are the tolerance instead.
+bool Close (Real a, Real b) {
+    double tolerance = std::max (EPSILON, 4.0 * std::numeric_limits<Real>::epsilon () * std::max (std::abs (a), std::abs (b)));
+    return std::abs (a - b) < tolerance;
+}
+}
 
 Vec3::Vec3 () : x (0), y (0), z (0) {}
-Vec3::Vec3 (double x, double y, double z) : x (x), y (y), z (z) {}
+Vec3::Vec3 (Real x, Real y, Real z) : x (x), y (y), z (z) {}
 
-double Vec3::Length () const {
+Real Vec3::Length () const {
     return std::sqrt (x * x + y * y + z * z);
 }
 
-double Vec3::Dot (const Vec3 &b) const {
+Real Vec3::Dot (const Vec3 &b) const {
     return x * b.x + y * b.y + z * b.z;
 }
 
@@ -19,14 +30,12 @@ Vec3 Vec3::Cross (const Vec3 &b) const {
 }
 
 Vec3 Vec3::Normalize () const {
-    double d = Length ();
+    Real d = Length ();
     return {x / d, y / d, z / d};
 }
 
 bool Vec3::operator== (const Vec3 &other) const {
-    return std::abs (x - other.x) < EPSILON &&
-           std::abs (y - other.y) < EPSILON &&
-           std::abs (z - other.z) < EPSILON;
+    return Close (x, other.x) && Close (y, other.y) && Close (z, other.z);
 }
 
 Vec3 Vec3::operator+ (const Vec3 &b) const {
@@ -37,7 +46,7 @@ Vec3 Vec3::operator- (const Vec3 &b) const {
     return {x - b.x, y - b.y, z - b.z};
 }
 
-Vec3 Vec3::operator* (double b) const {
+Vec3 Vec3::operator* (Real b) const {
     return {x * b, y * b, z * b};
 }
 
@@ -51,87 +60,59 @@ bool Vec3::operator< (const Vec3 &b) const {
     return z < b.z;
 }
 
-Matrix::Matrix () : row0{0, 0, 0, 0},
-                    row1{0, 0, 0, 0},
-                    row2{0, 0, 0, 0},
-                    row3{0, 0, 0, 0} {}
-
-Matrix::Matrix (double x00, double x01, double x02, double x03,
-                double x10, double x11, double x12, double x13,
-                double x20, double x21, double x22, double x23,
-                double x30, double x31, double x32, double x33)
-    : row0{x00, x01, x02, x03},
-      row1{x10, x11, x12, x13},
-      row2{x20, x21, x22, x23},
-      row3{x30, x31, x32, x33} {}
-
-double Matrix::QuadricError (Vec3 const &v) const {
-    return (v.x * row0[0] * v.x + v.y * row1[0] * v.x + v.z * row2[0] * v.x + row3[0] * v.x +
-            v.x * row0[1] * v.y + v.y * row1[1] * v.y + v.z * row2[1] * v.y + row3[1] * v.y +
-            v.x * row0[2] * v.z + v.y * row1[2] * v.z + v.z * row2[2] * v.z + row3[2] * v.z +
-            v.x * row0[3] + v.y * row1[3] + v.z * row2[3] + row3[3]);
-}
-
-Vec3 Matrix::QuadricVector () const {
-    Matrix b = {
-        row0[0], row0[1], row0[2], row0[3],
-        row1[0], row1[1], row1[2], row1[3],
-        row2[0], row2[1], row2[2], row2[3],
-        0, 0, 0, 1};
-    return b.Inverse ().MulPosition (Vec3 ());
-}
-
-Matrix Matrix::operator+ (const Matrix &b) const {
-    return Matrix{
-        row0[0] + b.row0[0], row0[1] + b.row0[1], row0[2] + b.row0[2], row0[3] + b.row0[3],
-        row1[0] + b.row1[0], row1[1] + b.row1[1], row1[2] + b.row1[2], row1[3] + b.row1[3],
-        row2[0] + b.row2[0], row2[1] + b.row2[1], row2[2] + b.row2[2], row2[3] + b.row2[3],
-        row3[0] + b.row3[0], row3[1] + b.row3[1], row3[2] + b.row3[2], row3[3] + b.row3[3]};
-}
-
-Vec3 Matrix::MulPosition (const Vec3 &b) const {
-    double x = row0[0] * b.x + row0[1] * b.y + row0[2] * b.z + row0[3];
-    double y = row1[0] * b.x + row1[1] * b.y + row1[2] * b.z + row1[3];
-    double z = row2[0] * b.x + row2[1] * b.y + row2[2] * b.z + row2[3];
-    return Vec3{x, y, z};
-}
-
-double Matrix::Determinant () const {
-    return (row0[0] * row1[1] * row2[2] * row3[3] - row0[0] * row1[1] * row2[3] * row3[2] +
-            row0[0] * row1[2] * row2[3] * row3[1] - row0[0] * row1[2] * row2[1] * row3[3] +
-            row0[0] * row1[3] * row2[1] * row3[2] - row0[0] * row1[3] * row2[2] * row3[1] -
-            row0[1] * row1[2] * row2[3] * row3[0] + row0[1] * row1[2] * row2[0] * row3[3] -
-            row0[1] * row1[3] * row2[0] * row3[2] + row0[1] * row1[3] * row2[2] * row3[0] -
-            row0[1] * row1[0] * row2[2] * row3[3] + row0[1] * row1[0] * row2[3] * row3[2] +
-            row0[2] * row1[3] * row2[0] * row3[1] - row0[2] * row1[3] * row2[1] * row3[0] +
-            row0[2] * row1[0] * row2[1] * row3[3] - row0[2] * row1[0] * row2[3] * row3[1] +
-            row0[2] * row1[1] * row2[3] * row3[0] - row0[2] * row1[1] * row2[0] * row3[3] -
-            row0[3] * row1[0] * row2[1] * row3[2] + row0[3] * row1[0] * row2[2] * row3[1] -
-            row0[3] * row1[1] * row2[2] * row3[0] + row0[3] * row1[1] * row2[0] * row3[2] -
-            row0[3] * row1[2] * row2[0] * row3[1] + row0[3] * row1[2] * row2[1] * row3[0]);
-}
-
-Matrix Matrix::Inverse () const {
-    Matrix m;
-    double r = 1. / Determinant ();
-    m.row0[0] = (row1[2] * row2[3] * row3[1] - row1[3] * row2[2] * row3[1] + row1[3] * row2[1] * row3[2] - row1[1] * row2[3] * row3[2] - row1[2] * row2[1] * row3[3] + row1[1] * row2[2] * row3[3]) * r;
-    m.row0[1] = (row0[3] * row2[2] * row3[1] - row0[2] * row2[3] * row3[1] - row0[3] * row2[1] * row3[2] + row0[1] * row2[3] * row3[2] + row0[2] * row2[1] * row3[3] - row0[1] * row2[2] * row3[3]) * r;
-    m.row0[2] = (row0[2] * row1[3] * row3[1] - row0[3] * row1[2] * row3[1] + row0[3] * row1[1] * row3[2] - row0[1] * row1[3] * row3[2] - row0[2] * row1[1] * row3[3] + row0[1] * row1[2] * row3[3]) * r;
-    m.row0[3] = (row0[3] * row1[2] * row2[1] - row0[2] * row1[3] * row2[1] - row0[3] * row1[1] * row2[2] + row0[1] * row1[3] * row2[2] + row0[2] * row1[1] * row2[3] - row0[1] * row1[2] * row2[3]) * r;
-    m.row1[0] = (row1[3] * row2[2] * row3[0] - row1[2] * row2[3] * row3[0] - row1[3] * row2[0] * row3[2] + row1[0] * row2[3] * row3[2] + row1[2] * row2[0] * row3[3] - row1[0] * row2[2] * row3[3]) * r;
-    m.row1[1] = (row0[2] * row2[3] * row3[0] - row0[3] * row2[2] * row3[0] + row0[3] * row2[0] * row3[2] - row0[0] * row2[3] * row3[2] - row0[2] * row2[0] * row3[3] + row0[0] * row2[2] * row3[3]) * r;
-    m.row1[2] = (row0[3] * row1[2] * row3[0] - row0[2] * row1[3] * row3[0] - row0[3] * row1[0] * row3[2] + row0[0] * row1[3] * row3[2] + row0[2] * row1[0] * row3[3] - row0[0] * row1[2] * row3[3]) * r;
-    m.row1[3] = (row0[2] * row1[3] * row2[0] - row0[3] * row1[2] * row2[0] + row0[3] * row1[0] * row2[2] - row0[0] * row1[3] * row2[2] - row0[2] * row1[0] * row2[3] + row0[0] * row1[2] * row2[3]) * r;
-    m.row2[0] = (row1[1] * row2[3] * row3[0] - row1[3] * row2[1] * row3[0] + row1[3] * row2[0] * row3[1] - row1[0] * row2[3] * row3[1] - row1[1] * row2[0] * row3[3] + row1[0] * row2[1] * row3[3]) * r;
-    m.row2[1] = (row0[3] * row2[1] * row3[0] - row0[1] * row2[3] * row3[0] - row0[3] * row2[0] * row3[1] + row0[0] * row2[3] * row3[1] + row0[1] * row2[0] * row3[3] - row0[0] * row2[1] * row3[3]) * r;
-    m.row2[2] = (row0[1] * row1[3] * row3[0] - row0[3] * row1[1] * row3[0] + row0[3] * row1[0] * row3[1] - row0[0] * row1[3] * row3[1] - row0[1] * row1[0] * row3[3] + row0[0] * row1[1] * row3[3]) * r;
-    m.row2[3] = (row0[3] * row1[1] * row2[0] - row0[1] * row1[3] * row2[0] - row0[3] * row1[0] * row2[1] + row0[0] * row1[3] * row2[1] + row0[1] * row1[0] * row2[3] - row0[0] * row1[1] * row2[3]) * r;
-    m.row3[0] = (row1[2] * row2[1] * row3[0] - row1[1] * row2[2] * row3[0] - row1[2] * row2[0] * row3[1] + row1[0] * row2[2] * row3[1] + row1[1] * row2[0] * row3[2] - row1[0] * row2[1] * row3[2]) * r;
-    m.row3[1] = (row0[1] * row2[2] * row3[0] - row0[2] * row2[1] * row3[0] + row0[2] * row2[0] * row3[1] - row0[0] * row2[2] * row3[1] - row0[1] * row2[0] * row3[2] + row0[0] * row2[1] * row3[2]) * r;
-    m.row3[2] = (row0[2] * row1[1] * row3[0] - row0[1] * row1[2] * row3[0] - row0[2] * row1[0] * row3[1] + row0[0] * row1[2] * row3[1] + row0[1] * row1[0] * row3[2] - row0[0] * row1[1] * row3[2]) * r;
-    m.row3[3] = (row0[1] * row1[2] * row2[0] - row0[2] * row1[1] * row2[0] + row0[2] * row1[0] * row2[1] - row0[0] * row1[2] * row2[1] - row0[1] * row1[0] * row2[2] + row0[0] * row1[1] * row2[2]) * r;
-    return m;
-};
+Quadric::Quadric () : m{} {}
+
+Quadric Quadric::Plane (double a, double b, double c, double d) {
+    Quadric q;
+    double const coefficients[SIZE] = {
+        a * a, a * b, a * c, a * d,
+        b * b, b * c, b * d,
+        c * c, c * d,
+        d * d};
+    std::copy (coefficients, coefficients + SIZE, q.m);
+    return q;
+}
+
+// v^T Q v with v = (x, y, z, 1), the off-diagonal terms count twice
+double Quadric::Error (const Vec3 &v) const {
+    return v.x * (m[0] * v.x + 2 * (m[1] * v.y + m[2] * v.z + m[3])) +
+           v.y * (m[4] * v.y + 2 * (m[5] * v.z + m[6])) +
+           v.z * (m[7] * v.z + 2 * m[8]) +
+           m[9];
+}
+
+// Solves the 3x3 part against the negated last column through its adjugate.
+// The determinant is compared to the cubed trace, so the test does not depend on scale
+bool Quadric::Optimum (Vec3 &v) const {
+    double c00 = m[4] * m[7] - m[5] * m[5];
+    double c01 = m[2] * m[5] - m[1] * m[7];
+    double c02 = m[1] * m[5] - m[2] * m[4];
+    double det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+    double trace = m[0] + m[4] + m[7];
+    if (!(std::abs (det) > SINGULAR * trace * trace * trace)) {
+        return false;
+    }
+    double c11 = m[0] * m[7] - m[2] * m[2];
+    double c12 = m[1] * m[2] - m[0] * m[5];
+    double c22 = m[0] * m[4] - m[1] * m[1];
+    double r = -1. / det;
+    v = Vec3 ((c00 * m[3] + c01 * m[6] + c02 * m[8]) * r,
+              (c01 * m[3] + c11 * m[6] + c12 * m[8]) * r,
+              (c02 * m[3] + c12 * m[6] + c22 * m[8]) * r);
+    return true;
+}
+
+Quadric Quadric::operator+ (const Quadric &b) const {
+    Quadric q = *this;
+    return q += b;
+}
+
+Quadric &Quadric::operator+= (const Quadric &b) {
+    for (size_t i = 0; i < SIZE; ++i) {
+        m[i] += b.m[i];
+    }
+    return *this;
+}
 
 Triangle::Triangle (const Vec3 &v1, const Vec3 &v2, const Vec3 &v3) : v1 (v1), v2 (v2), v3 (v3) {}
 
@@ -141,40 +122,38 @@ Vec3 Triangle::Normal () const {
     return e1.Cross (e2).Normalize ();
 }
 
-Matrix Triangle::Quadric () const {
+Quadric Triangle::Quadric () const {
     Vec3 n = Normal ();
-    double x = v1.x, y = v1.y, z = v1.z;
-    double a = n.x, b = n.y, c = n.z;
-    double d = -a * x - b * y - c * z;
-    return Matrix{
-        a * a, a * b, a * c, a * d,
-        a * b, b * b, b * c, b * d,
-        a * c, b * c, c * c, c * d,
-        a * d, b * d, c * d, d * d};
+    double d = -(static_cast<double> (n.x) * v1.x + static_cast<double> (n.y) * v1.y + static_cast<double> (n.z) * v1.z);
+    return Quadric::Plane (n.x, n.y, n.z, d);
 }
 
-Face::Face (Vertex const *v1, Vertex const *v2, Vertex const *v3) : v1 (v1), v2 (v2), v3 (v3) {}
-
-bool Face::Degenerate () const {
-    return v1->v == v2->v ||
-           v1->v == v3->v ||
-           v2->v == v3->v;
+bool Triangle::Degenerate () const {
+    return v1 == v2 ||
+           v1 == v3 ||
+           v2 == v3;
 }
 
-Vec3 Face::Normal () const {
-    Vec3 e1 = v2->v - v1->v;
-    Vec3 e2 = v3->v - v1->v;
-    return e1.Cross (e2).Normalize ();
-}
+Face::Face (uint32_t v1, uint32_t v2, uint32_t v3) : v1 (v1), v2 (v2), v3 (v3) {}
 
-bool Face::operator< (const Face &other) const {
-    if (v1->v != other.v1->v)
-        return v1->v < other.v1->v;
+bool Face::Contains (uint32_t v) const {
+    return v1 == v || v2 == v || v3 == v;
+}
 
-    if (v2->v != other.v2->v)
-        return v2->v < other.v2->v;
+void Face::Replace (uint32_t from, uint32_t to) {
+    if (v1 == from) {
+        v1 = to;
+    }
+    if (v2 == from) {
+        v2 = to;
+    }
+    if (v3 == from) {
+        v3 = to;
+    }
+}
 
-    return v3->v < other.v3->v;
+Triangle Face::ToTriangle (std::pmr::vector<Vertex> const &vertices) const {
+    return Triangle (vertices[v1].v, vertices[v2].v, vertices[v3].v);
 }
 
 bool Vec3::operator!= (const Vec3 &other) const {
@@ -1,16 +1,31 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
 #include <vector>
 
+// Scalar of positions and meshes. A SIMPLIFIER_FLOAT build stores them in single
+// precision like the STL files do, quadrics and errors stay double either way
+#ifdef SIMPLIFIER_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
+// Positions closer than this on every axis are equal, Vec3::operator== widens it to a few
+// units in the last place of Real at large coordinates
 static constexpr double EPSILON = 1e-6;
+// Quadric::Optimum gives up when det < SINGULAR * trace^3 of the 3x3 part
+static constexpr double SINGULAR = 1e-9;
 
 struct Vec3 {
-    double x, y, z;
+    Real x, y, z;
 
     Vec3 ();
-    Vec3 (double x, double y, double z);
+    Vec3 (Real x, Real y, Real z);
 
-    double Length () const;
-    double Dot (const Vec3 &b) const;
+    Real Length () const;
+    Real Dot (const Vec3 &b) const;
     Vec3 Cross (const Vec3 &b) const;
     Vec3 Normalize () const;
     bool operator== (const Vec3 &other) const;
@@ -18,28 +33,28 @@ struct Vec3 {
     bool operator< (const Vec3 &b) const;
     Vec3 operator+ (const Vec3 &b) const;
     Vec3 operator- (const Vec3 &b) const;
-    Vec3 operator* (double b) const;
+    Vec3 operator* (Real b) const;
 };
 
-class Matrix {
-  public:
-    double row0[4];
-    double row1[4];
-    double row2[4];
-    double row3[4];
-
-    Matrix ();
-
-    Matrix (double x00, double x01, double x02, double x03,
-            double x10, double x11, double x12, double x13,
-            double x20, double x21, double x22, double x23,
-            double x30, double x31, double x32, double x33);
-    double QuadricError (const Vec3 &v) const;
-    Vec3 QuadricVector () const;
-    Matrix operator+ (const Matrix &b) const;
-    Vec3 MulPosition (const Vec3 &b) const;
-    double Determinant () const;
-    Matrix Inverse () const;
+// Symmetric 4x4 error quadric as its upper triangle in row order:
+//   a2 ab ac ad
+//      b2 bc bd
+//         c2 cd
+//            d2
+// Ten contiguous coefficients, sums run as one vectorizable loop.
+struct Quadric {
+    static constexpr size_t SIZE = 10;
+    double m[SIZE];
+
+    Quadric ();
+    // Squared distance to the plane ax + by + cz + d = 0
+    static Quadric Plane (double a, double b, double c, double d);
+
+    double Error (const Vec3 &v) const;
+    // Position of the least error in closed form, false if the 3x3 part is near singular
+    bool Optimum (Vec3 &v) const;
+    Quadric operator+ (const Quadric &b) const;
+    Quadric &operator+= (const Quadric &b);
 };
 
 struct Triangle {
@@ -48,33 +63,31 @@ struct Triangle {
     Triangle () {};
     Triangle (const Vec3 &v1, const Vec3 &v2, const Vec3 &v3);
 
-    Matrix Quadric () const;
+    ::Quadric Quadric () const;
     Vec3 Normal () const;
+    bool Degenerate () const;
 };
 
 using Mesh = std::vector<Triangle>;
 
 struct Vertex {
     Vec3 v;
-    Matrix q; // Error quadric matrix
+    Quadric q; // Error quadric
 
     Vertex () {};
     Vertex (Vertex const &other) : v (other.v), q (other.q) {}
     Vertex (Vec3 const &v) : v (v) {}
-    Vertex (Vec3 const &v, Matrix q) : v (v), q (q) {}
+    Vertex (Vec3 const &v, Quadric const &q) : v (v), q (q) {}
 };
 
-class Face {
-  public:
-    Vertex const *v1;
-    Vertex const *v2;
-    Vertex const *v3;
-    mutable bool Removed = false;
-
-    bool operator< (const Face &other) const;
+// Triangle of the indexed working mesh, refers to vertexes by index
+struct Face {
+    uint32_t v1, v2, v3;
+    bool Removed = false;
 
-    Face (Vertex const *v1, Vertex const *v2, Vertex const *v3);
+    Face (uint32_t v1, uint32_t v2, uint32_t v3);
 
-    bool Degenerate () const;
-    Vec3 Normal () const;
+    bool Contains (uint32_t v) const;
+    void Replace (uint32_t from, uint32_t to);
+    Triangle ToTriangle (std::pmr::vector<Vertex> const &vertices) const;
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "IndexedHeap.hpp"
+
+IndexedHeap::IndexedHeap (std::pmr::memory_resource *resource) : nodes (resource), positions (resource) {}
+
+void IndexedHeap::Build (std::pmr::vector<double> const &priorities) {
+    nodes.resize (priorities.size ());
+    positions.resize (priorities.size ());
+    for (size_t i = 0; i < priorities.size (); ++i) {
+        nodes[i] = Node{priorities[i], static_cast<uint32_t> (i)};
+        positions[i] = static_cast<uint32_t> (i);
+    }
+    for (size_t i = nodes.size () / 2; i-- > 0;) {
+        SiftDown (i);
+    }
+}
+
+uint32_t IndexedHeap::Pop () {
+    uint32_t id = nodes.front ().id;
+    Remove (id);
+    return id;
+}
+
+void IndexedHeap::Push (uint32_t id, double priority) {
+    if (id >= positions.size ()) {
+        positions.resize (id + 1, NPOS);
+    }
+    nodes.push_back (Node{priority, id});
+    positions[id] = static_cast<uint32_t> (nodes.size () - 1);
+    SiftUp (nodes.size () - 1);
+}
+
+void IndexedHeap::Update (uint32_t id, double priority) {
+    if (!Contains (id)) {
+        Push (id, priority);
+        return;
+    }
+    size_t i = positions[id];
+    double old = nodes[i].priority;
+    nodes[i].priority = priority;
+    if (priority < old) {
+        SiftUp (i);
+    } else {
+        SiftDown (i);
+    }
+}
+
+void IndexedHeap::Remove (uint32_t id) {
+    if (!Contains (id)) {
+        return;
+    }
+    size_t i = positions[id];
+    positions[id] = NPOS;
+    Node last = nodes.back ();
+    nodes.pop_back ();
+    if (i == nodes.size ()) {
+        return;
+    }
+    Place (i, last);
+    if (i > 0 && last < nodes[(i - 1) / 2]) {
+        SiftUp (i);
+    } else {
+        SiftDown (i);
+    }
+}
+
+void IndexedHeap::Place (size_t i, Node const &node) {
+    nodes[i] = node;
+    positions[node.id] = static_cast<uint32_t> (i);
+}
+
+void IndexedHeap::SiftUp (size_t i) {
+    Node node = nodes[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!(node < nodes[parent])) {
+            break;
+        }
+        Place (i, nodes[parent]);
+        i = parent;
+    }
+    Place (i, node);
+}
+
+void IndexedHeap::SiftDown (size_t i) {
+    Node node = nodes[i];
+    size_t n = nodes.size ();
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && nodes[child + 1] < nodes[child]) {
+            child++;
+        }
+        if (!(nodes[child] < node)) {
+            break;
+        }
+        Place (i, nodes[child]);
+        i = child;
+    }
+    Place (i, node);
+}
+
+size_t IndexedHeap::Bytes () const {
+    return nodes.capacity () * sizeof (Node) + positions.capacity () * sizeof (uint32_t);
+}
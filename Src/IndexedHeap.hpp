@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Binary min-heap over element ids [0, capacity) with a position table,
+// so a queued element can be re-prioritized or removed in O(log n).
+// Ties are broken by id to keep the pop order deterministic.
+class IndexedHeap {
+  public:
+    static constexpr uint32_t NPOS = UINT32_MAX;
+
+    explicit IndexedHeap (std::pmr::memory_resource *resource = std::pmr::get_default_resource ());
+
+    // Queue ids 0..priorities.size () - 1 in O(n)
+    void Build (std::pmr::vector<double> const &priorities);
+
+    bool Empty () const { return nodes.empty (); }
+    size_t Size () const { return nodes.size (); }
+    bool Contains (uint32_t id) const { return id < positions.size () && positions[id] != NPOS; }
+    uint32_t Top () const { return nodes.front ().id; }
+    double TopPriority () const { return nodes.front ().priority; }
+
+    uint32_t Pop ();
+    void Push (uint32_t id, double priority);
+    // Change the priority of a queued id, queue it if it is not queued
+    void Update (uint32_t id, double priority);
+    void Remove (uint32_t id);
+
+    size_t Bytes () const;
+
+  private:
+    struct Node {
+        double priority;
+        uint32_t id;
+
+        bool operator< (Node const &other) const {
+            return priority < other.priority || (priority == other.priority && id < other.id);
+        }
+    };
+
+    std::pmr::vector<Node> nodes;
+    std::pmr::vector<uint32_t> positions;
+
+    void Place (size_t i, Node const &node);
+    void SiftUp (size_t i);
+    void SiftDown (size_t i);
+};
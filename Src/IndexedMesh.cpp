@@ -0,0 +1,57 @@
+#include "IndexedMesh.hpp"
+#include <algorithm>
+
+Adjacency::Adjacency (std::pmr::memory_resource *resource)
+    : offsets (resource), counts (resource), items (resource) {}
+
+Adjacency::Range Adjacency::Get (uint32_t key) const {
+    uint32_t const *first = items.data () + offsets[key];
+    return Range{first, first + counts[key]};
+}
+
+void Adjacency::Assign (uint32_t key, std::pmr::vector<uint32_t> const &list) {
+    Clear (key);
+    if (list.empty ()) {
+        return;
+    }
+    if (items.size () + HEADER + list.size () > items.capacity ()) {
+        Compact ();
+    }
+
+    items.push_back (key);
+    items.push_back (static_cast<uint32_t> (list.size ()));
+    offsets[key] = static_cast<uint32_t> (items.size ());
+    counts[key] = static_cast<uint32_t> (list.size ());
+    items.insert (items.end (), list.begin (), list.end ());
+    liveItems += list.size ();
+}
+
+void Adjacency::Clear (uint32_t key) {
+    liveItems -= counts[key];
+    counts[key] = 0;
+}
+
+// Slide the live ranges to the front, in place
+void Adjacency::Compact () {
+    size_t write = 0;
+    for (size_t read = 0; read < items.size ();) {
+        uint32_t key = items[read];
+        uint32_t length = items[read + 1];
+        if (counts[key] > 0 && offsets[key] == read + HEADER) {
+            std::copy (items.begin () + read, items.begin () + read + HEADER + length, items.begin () + write);
+            offsets[key] = static_cast<uint32_t> (write + HEADER);
+            write += HEADER + length;
+        }
+        read += HEADER + length;
+    }
+    items.resize (write);
+}
+
+IndexedMesh::IndexedMesh ()
+    : arena (std::make_unique<Arena> ()),
+      vertices (arena->Resource ()),
+      faces (arena->Resource ()),
+      edges (arena->Resource ()),
+      locked (arena->Resource ()),
+      vertexFaces (arena->Resource ()),
+      vertexEdges (arena->Resource ()) {}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Arena.hpp"
+#include "Edge.hpp"
+#include "Geometry.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Vertex => element adjacency in CSR form: every key owns a range of one shared index array.
+// Each range is preceded by a [key, length] header. Rewritten lists are appended
+// to the end of the array and the abandoned ranges are reclaimed in place by
+// Compact () when the reserved capacity runs out, so updates do not allocate.
+class Adjacency {
+  public:
+    struct Range {
+        uint32_t const *first;
+        uint32_t const *last;
+
+        uint32_t const *begin () const { return first; }
+        uint32_t const *end () const { return last; }
+        size_t size () const { return static_cast<size_t> (last - first); }
+    };
+
+    explicit Adjacency (std::pmr::memory_resource *resource = std::pmr::get_default_resource ());
+
+    // keyOf (element, k) returns the k-th of the `stride` keys of an element
+    template <typename KeyOf>
+    void Build (size_t keyCount, size_t elementCount, size_t stride, KeyOf keyOf);
+
+    // Ranges are invalidated by Assign ()
+    Range Get (uint32_t key) const;
+    void Assign (uint32_t key, std::pmr::vector<uint32_t> const &list);
+    void Clear (uint32_t key);
+    void Compact ();
+    size_t Bytes () const { return (offsets.capacity () + counts.capacity () + items.capacity ()) * sizeof (uint32_t); }
+
+  private:
+    std::pmr::vector<uint32_t> offsets;
+    std::pmr::vector<uint32_t> counts;
+    std::pmr::vector<uint32_t> items;
+    size_t liveItems = 0;
+
+    static constexpr size_t HEADER = 2;
+};
+
+template <typename KeyOf>
+void Adjacency::Build (size_t keyCount, size_t elementCount, size_t stride, KeyOf keyOf) {
+    offsets.assign (keyCount, 0);
+    counts.assign (keyCount, 0);
+    for (size_t e = 0; e < elementCount; ++e) {
+        for (size_t k = 0; k < stride; ++k) {
+            counts[keyOf (e, k)]++;
+        }
+    }
+
+    uint32_t offset = 0;
+    liveItems = 0;
+    for (size_t key = 0; key < keyCount; ++key) {
+        offsets[key] = offset + HEADER;
+        offset += HEADER + counts[key];
+        liveItems += counts[key];
+        counts[key] = 0;
+    }
+
+    // Room for rewrites: a compaction always frees at least half of the capacity
+    items.clear ();
+    items.reserve (2 * offset + 1024);
+    items.resize (offset);
+    for (size_t e = 0; e < elementCount; ++e) {
+        for (size_t k = 0; k < stride; ++k) {
+            uint32_t key = keyOf (e, k);
+            items[offsets[key] + counts[key]++] = static_cast<uint32_t> (e);
+        }
+    }
+    for (size_t key = 0; key < keyCount; ++key) {
+        items[offsets[key] - HEADER] = static_cast<uint32_t> (key);
+        items[offsets[key] - 1] = counts[key];
+    }
+}
+
+// Contiguous working mesh of Simplify (), every reference is a 32 bit index.
+// All arrays are allocated from the arena owned by the mesh.
+struct IndexedMesh {
+    std::unique_ptr<Arena> arena;
+    std::pmr::vector<Vertex> vertices;
+    std::pmr::vector<Face> faces;
+    std::pmr::vector<Edge> edges;
+    std::pmr::vector<uint8_t> locked; // per vertex, empty when nothing is locked
+    Adjacency vertexFaces;
+    Adjacency vertexEdges;
+
+    IndexedMesh ();
+    std::pmr::memory_resource *Resource () const { return arena->Resource (); }
+};
@@ -0,0 +1,86 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile (fs::path const &path) {
+    file = CreateFileW (path.wstring ().c_str (), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw std::runtime_error ("Cannot open file " + path.string ());
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx (file, &fileSize)) {
+        CloseHandle (file);
+        throw std::runtime_error ("Cannot read size of " + path.string ());
+    }
+    size = static_cast<size_t> (fileSize.QuadPart);
+    if (size == 0) {
+        return;
+    }
+    mapping = CreateFileMappingW (file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) {
+        data = static_cast<char const *> (MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!data) {
+        if (mapping) {
+            CloseHandle (mapping);
+        }
+        CloseHandle (file);
+        throw std::runtime_error ("Cannot map file " + path.string ());
+    }
+}
+
+MappedFile::~MappedFile () {
+    if (data) {
+        UnmapViewOfFile (data);
+    }
+    if (mapping) {
+        CloseHandle (mapping);
+    }
+    if (file) {
+        CloseHandle (file);
+    }
+}
+#else
+MappedFile::MappedFile (fs::path const &path) {
+    file = open (path.c_str (), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error ("Cannot open file " + path.string ());
+    }
+    struct stat info;
+    if (fstat (file, &info) != 0) {
+        close (file);
+        throw std::runtime_error ("Cannot read size of " + path.string ());
+    }
+    size = static_cast<size_t> (info.st_size);
+    if (size == 0) {
+        return;
+    }
+    void *mapped = mmap (nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (mapped == MAP_FAILED) {
+        close (file);
+        throw std::runtime_error ("Cannot map file " + path.string ());
+    }
+    madvise (mapped, size, MADV_SEQUENTIAL);
+    data = static_cast<char const *> (mapped);
+}
+
+MappedFile::~MappedFile () {
+    if (data) {
+        munmap (const_cast<char *> (data), size);
+    }
+    close (file);
+}
+#endif
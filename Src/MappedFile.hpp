@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Read-only memory mapping of a whole file, unmapped on destruction
+class MappedFile {
+  public:
+    explicit MappedFile (fs::path const &path);
+    MappedFile (MappedFile const &) = delete;
+    MappedFile &operator= (MappedFile const &) = delete;
+    ~MappedFile ();
+
+    char const *Data () const { return data; }
+    size_t Size () const { return size; }
+
+  private:
+    char const *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr;
+    void *mapping = nullptr;
+#else
+    int file = -1;
+#endif
+};
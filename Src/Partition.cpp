@@ -0,0 +1,170 @@
+#include "Partition.hpp"
+#include "Simplifier.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+// Rings of vertices around the frozen ones the final pass may move
+constexpr size_t SEAM_RINGS = 2;
+
+double Centroid (Triangle const &t, int axis) {
+    Vec3 c = t.v1 + t.v2 + t.v3;
+    return axis == 0 ? c.x : axis == 1 ? c.y : c.z;
+}
+
+// Median splits along the longest axis of the centroid bounds, 2^depth blocks
+void SplitBlocks (Mesh const &input, uint32_t *first, uint32_t *last, size_t depth, uint32_t block, std::vector<uint32_t> &blockOf) {
+    if (depth == 0 || last - first < 2) {
+        for (uint32_t *f = first; f != last; ++f) {
+            blockOf[*f] = block;
+        }
+        return;
+    }
+
+    // Centroids scaled by 3, the sums compare the same
+    Vec3 lo = input[*first].v1 + input[*first].v2 + input[*first].v3, hi = lo;
+    for (uint32_t *f = first + 1; f != last; ++f) {
+        Vec3 c = input[*f].v1 + input[*f].v2 + input[*f].v3;
+        lo = Vec3 (std::min (lo.x, c.x), std::min (lo.y, c.y), std::min (lo.z, c.z));
+        hi = Vec3 (std::max (hi.x, c.x), std::max (hi.y, c.y), std::max (hi.z, c.z));
+    }
+    Vec3 extent = hi - lo;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+    uint32_t *middle = first + (last - first) / 2;
+    std::nth_element (first, middle, last, [&input, axis] (uint32_t a, uint32_t b) {
+        return Centroid (input[a], axis) < Centroid (input[b], axis);
+    });
+    SplitBlocks (input, first, middle, depth - 1, 2 * block, blockOf);
+    SplitBlocks (input, middle, last, depth - 1, 2 * block + 1, blockOf);
+}
+}
+
+Mesh SimplifyPartitioned (Mesh const &input, double factor, SimplifyOptions const &options, SimplifyStats *stats) {
+    Trace::Scope trace ("SimplifyPartitioned");
+    // The blocks together need about what the whole mesh would, fail before splitting the budget
+    CheckMemoryLimit (input.size () * WORKING_BYTES_PER_FACE, options.memoryLimit, "Simplifying " + std::to_string (input.size ()) + " faces");
+    ThreadPool pool (options.threads);
+    size_t depth = 1;
+    while ((size_t{1} << depth) < 2 * pool.Size ()) {
+        depth++;
+    }
+    size_t blockCount = size_t{1} << depth;
+
+    // Weld once so every block sees the same coordinates for a shared vertex
+    VertexWelder welder (options.weldTolerance, input.size ());
+    std::vector<uint32_t> corners (3 * input.size ());
+    for (size_t i = 0; i < input.size (); ++i) {
+        corners[3 * i] = welder.Weld (input[i].v1);
+        corners[3 * i + 1] = welder.Weld (input[i].v2);
+        corners[3 * i + 2] = welder.Weld (input[i].v3);
+    }
+    std::vector<Vec3> const &positions = welder.Positions ();
+
+    std::vector<uint32_t> order (input.size ());
+    std::iota (order.begin (), order.end (), 0);
+    std::vector<uint32_t> blockOf (input.size ());
+    SplitBlocks (input, order.data (), order.data () + order.size (), depth, 0, blockOf);
+
+    // Vertices used by faces of more than one block are frozen
+    static constexpr uint32_t NONE = UINT32_MAX;
+    std::vector<uint32_t> owner (positions.size (), NONE);
+    std::vector<bool> border (positions.size (), false);
+    for (size_t i = 0; i < corners.size (); ++i) {
+        uint32_t &o = owner[corners[i]];
+        if (o == NONE) {
+            o = blockOf[i / 3];
+        } else if (o != blockOf[i / 3]) {
+            border[corners[i]] = true;
+        }
+    }
+
+    std::vector<Mesh> blocks (blockCount);
+    std::vector<std::vector<bool>> blockLocks (blockCount);
+    std::vector<size_t> seamFaces (blockCount, 0);
+    for (size_t i = 0; i < input.size (); ++i) {
+        uint32_t b = blockOf[i];
+        uint32_t const *c = &corners[3 * i];
+        blocks[b].emplace_back (positions[c[0]], positions[c[1]], positions[c[2]]);
+        blockLocks[b].insert (blockLocks[b].end (), {border[c[0]], border[c[1]], border[c[2]]});
+        seamFaces[b] += border[c[0]] || border[c[1]] || border[c[2]];
+    }
+
+    // Faces touching the seam are left for the final pass, the rest of a block is reduced by factor
+    std::vector<Mesh> results (blockCount);
+    std::vector<std::vector<bool>> resultLocks (blockCount);
+    std::vector<SimplifyStats> blockStats (blockCount);
+    SimplifyOptions blockOptions = options;
+    blockOptions.threads = 1;
+    // Every thread simplifies a block at a time. The mesh fits the limit, so an uneven split
+    // may give the largest block more than its thread's share.
+    if (options.memoryLimit != 0) {
+        size_t largest = 0;
+        for (Mesh const &block : blocks) {
+            largest = std::max (largest, block.size ());
+        }
+        blockOptions.memoryLimit = std::max (options.memoryLimit / pool.Size (), largest * WORKING_BYTES_PER_FACE);
+    }
+    auto simplifyBlocks = [&] (size_t begin, size_t end) {
+        for (size_t b = begin; b < end; ++b) {
+            Simplifier simplifier (blocks[b], blockOptions, blockLocks[b]);
+            simplifier.Run (static_cast<size_t> ((blocks[b].size () - seamFaces[b]) * factor) + seamFaces[b]);
+            results[b] = simplifier.Result ();
+            resultLocks[b] = simplifier.LockedCorners ();
+            blockStats[b] = simplifier.Stats ();
+            Mesh ().swap (blocks[b]);
+        }
+    };
+    // A block over its limit throws on a worker, ParallelFor rethrows it here
+    pool.ParallelFor (blockCount, simplifyBlocks, 1);
+
+    // Stitch, the frozen vertices still have their exact input coordinates
+    Mesh stitched;
+    std::vector<bool> seamCorners;
+    for (size_t b = 0; b < blockCount; ++b) {
+        stitched.insert (stitched.end (), results[b].begin (), results[b].end ());
+        seamCorners.insert (seamCorners.end (), resultLocks[b].begin (), resultLocks[b].end ());
+    }
+
+    // Seam region: the frozen vertices grown by SEAM_RINGS rings, everything else is locked for the final pass
+    VertexWelder stitchWelder (options.weldTolerance, stitched.size ());
+    std::vector<uint32_t> stitchedCorners (3 * stitched.size ());
+    for (size_t i = 0; i < stitched.size (); ++i) {
+        stitchedCorners[3 * i] = stitchWelder.Weld (stitched[i].v1);
+        stitchedCorners[3 * i + 1] = stitchWelder.Weld (stitched[i].v2);
+        stitchedCorners[3 * i + 2] = stitchWelder.Weld (stitched[i].v3);
+    }
+    std::vector<bool> seamVertex (stitchWelder.Positions ().size (), false);
+    for (size_t i = 0; i < stitchedCorners.size (); ++i) {
+        if (seamCorners[i]) {
+            seamVertex[stitchedCorners[i]] = true;
+        }
+    }
+    for (size_t ring = 0; ring < SEAM_RINGS; ++ring) {
+        std::vector<bool> grown = seamVertex;
+        for (size_t i = 0; i < stitched.size (); ++i) {
+            uint32_t const *c = &stitchedCorners[3 * i];
+            if (seamVertex[c[0]] || seamVertex[c[1]] || seamVertex[c[2]]) {
+                grown[c[0]] = grown[c[1]] = grown[c[2]] = true;
+            }
+        }
+        seamVertex.swap (grown);
+    }
+    std::vector<bool> finalLocks (stitchedCorners.size ());
+    for (size_t i = 0; i < stitchedCorners.size (); ++i) {
+        finalLocks[i] = !seamVertex[stitchedCorners[i]];
+    }
+
+    Simplifier seamPass (stitched, options, finalLocks);
+    seamPass.Run (static_cast<size_t> (input.size () * factor));
+
+    // The final pass rebuilds its quadrics from the stitched blocks, it adds the error of the seam collapses
+    if (stats) {
+        *stats = seamPass.Stats ();
+        for (SimplifyStats const &s : blockStats) {
+            Accumulate (*stats, s);
+        }
+    }
+    return seamPass.Result ();
+}
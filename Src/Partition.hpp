@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Simplify.hpp"
+
+// Spatially partitioned parallel simplification. The faces are split into blocks by a
+// k-d split of their centroids and the blocks are simplified concurrently with the
+// vertices they share frozen. The stitched mesh then gets a final serial pass that may
+// only collapse edges around the seams.
+Mesh SimplifyPartitioned (Mesh const &input, double factor, SimplifyOptions const &options = {}, SimplifyStats *stats = nullptr);
@@ -0,0 +1,219 @@
+#include "PerfCounters.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+bool PerfCounters::started = false;
+
+namespace {
+struct Phase {
+    char const *name;
+    size_t calls = 0;
+    uint64_t nanoseconds = 0;
+    double value[PerfCounters::EVENT_COUNT] = {};
+    bool measured[PerfCounters::EVENT_COUNT] = {};
+};
+
+std::string unavailable;
+std::vector<Phase> phases;
+std::thread::id owner;
+
+char const *const EVENT_NAMES[PerfCounters::EVENT_COUNT] = {"cycles", "instructions", "L1d misses", "LLC misses", "branch misses"};
+
+#ifdef __linux__
+int leader = -1;
+std::vector<int> descriptors;
+// Position of each event in a group read, -1 when the CPU or kernel does not have it
+int slot[PerfCounters::EVENT_COUNT];
+
+void Configure (PerfCounters::Event event, perf_event_attr &attr) {
+    switch (event) {
+    case PerfCounters::Cycles:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case PerfCounters::Instructions:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case PerfCounters::L1Misses:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    case PerfCounters::LLCMisses:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    }
+}
+
+void Close () {
+    for (int fd : descriptors) {
+        close (fd);
+    }
+    descriptors.clear ();
+    leader = -1;
+}
+#endif
+}
+
+bool PerfCounters::Start () {
+    phases.clear ();
+#ifdef __linux__
+    // The first event that opens leads the group, the others are read along with it in one call
+    int error = 0;
+    for (int e = 0; e < EVENT_COUNT; ++e) {
+        perf_event_attr attr;
+        std::memset (&attr, 0, sizeof (attr));
+        attr.size = sizeof (attr);
+        Configure (static_cast<Event> (e), attr);
+        attr.disabled = leader < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        int fd = static_cast<int> (syscall (SYS_perf_event_open, &attr, 0, -1, leader, 0));
+        if (fd < 0) {
+            slot[e] = -1;
+            error = errno;
+            continue;
+        }
+        if (leader < 0) {
+            leader = fd;
+        }
+        slot[e] = static_cast<int> (descriptors.size ());
+        descriptors.push_back (fd);
+    }
+    if (leader < 0) {
+        unavailable = std::string ("perf_event_open failed: ") + std::strerror (error);
+        if (error == EACCES || error == EPERM) {
+            unavailable += ", see /proc/sys/kernel/perf_event_paranoid";
+        } else if (error == ENOENT || error == ENOSYS || error == EOPNOTSUPP) {
+            unavailable += ", no hardware counters here (virtual machine or container?)";
+        }
+        return false;
+    }
+    ioctl (leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl (leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    owner = std::this_thread::get_id ();
+    started = true;
+    return true;
+#else
+    unavailable = "hardware counters need Linux perf_event_open";
+    return false;
+#endif
+}
+
+std::string const &PerfCounters::Unavailable () {
+    return unavailable;
+}
+
+bool PerfCounters::Counting () {
+    return started && std::this_thread::get_id () == owner;
+}
+
+PerfCounters::Sample PerfCounters::Read () {
+    Sample sample;
+#ifdef __linux__
+    if (!Counting ()) {
+        return sample;
+    }
+    // nr, time enabled, time running, then the values in the order the events joined the group
+    uint64_t buffer[3 + EVENT_COUNT];
+    if (read (leader, buffer, sizeof (buffer)) < static_cast<ssize_t> (3 * sizeof (uint64_t))) {
+        return sample;
+    }
+    sample.enabled = buffer[1];
+    sample.running = buffer[2];
+    for (int e = 0; e < EVENT_COUNT; ++e) {
+        if (slot[e] >= 0 && static_cast<uint64_t> (slot[e]) < buffer[0]) {
+            sample.value[e] = buffer[3 + slot[e]];
+        }
+    }
+#endif
+    return sample;
+}
+
+void PerfCounters::Add (char const *phase, Sample const &begin, Sample const &end) {
+    auto found = std::find_if (phases.begin (), phases.end (), [phase] (Phase const &p) { return std::strcmp (p.name, phase) == 0; });
+    if (found == phases.end ()) {
+        phases.push_back ({phase});
+        found = phases.end () - 1;
+    }
+    found->calls++;
+    found->nanoseconds += end.enabled - begin.enabled;
+
+    // The group was scheduled only part of the time when the PMU was shared, extrapolate
+    uint64_t running = end.running - begin.running;
+    if (running == 0) {
+        return;
+    }
+    double scale = static_cast<double> (end.enabled - begin.enabled) / running;
+#ifdef __linux__
+    for (int e = 0; e < EVENT_COUNT; ++e) {
+        if (slot[e] >= 0) {
+            found->value[e] += (end.value[e] - begin.value[e]) * scale;
+            found->measured[e] = true;
+        }
+    }
+#endif
+}
+
+void PerfCounters::Report (Logger const &l) {
+    if (!started) {
+        return;
+    }
+#ifdef __linux__
+    ioctl (leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    Close ();
+#endif
+    started = false;
+
+    auto cell = [] (std::ostringstream &row, double value, bool measured) {
+        if (measured) {
+            row << std::setw (15) << std::fixed << std::setprecision (0) << value;
+        } else {
+            row << std::setw (15) << "n/a";
+        }
+    };
+    std::ostringstream header;
+    header << std::left << std::setw (28) << "phase" << std::right << std::setw (7) << "calls" << std::setw (10) << "ms";
+    for (char const *name : EVENT_NAMES) {
+        header << std::setw (15) << name;
+    }
+    header << std::setw (7) << "IPC";
+    l.Log ("Performance counters of the main thread:");
+    l.Log (header.str ());
+    for (Phase const &p : phases) {
+        std::ostringstream row;
+        row << std::left << std::setw (28) << p.name << std::right << std::setw (7) << p.calls
+            << std::setw (10) << std::fixed << std::setprecision (1) << p.nanoseconds / 1e6;
+        for (int e = 0; e < EVENT_COUNT; ++e) {
+            cell (row, p.value[e], p.measured[e]);
+        }
+        bool ipc = p.measured[Cycles] && p.measured[Instructions] && p.value[Cycles] > 0;
+        if (ipc) {
+            row << std::setw (7) << std::setprecision (2) << p.value[Instructions] / p.value[Cycles];
+        } else {
+            row << std::setw (7) << "n/a";
+        }
+        l.Log (row.str ());
+    }
+    phases.clear ();
+}
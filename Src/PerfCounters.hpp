@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class Logger;
+
+// Hardware performance counters per pipeline phase, Linux perf_event_open only.
+// The phases are the Trace scopes, counted on the thread that called Start:
+// work that a phase hands to pool threads is not included.
+namespace PerfCounters {
+extern bool started;
+
+enum Event { Cycles,
+             Instructions,
+             L1Misses,
+             LLCMisses,
+             BranchMisses,
+             EVENT_COUNT };
+
+// Raw counts, with the nanoseconds the group was enabled and running to scale multiplexed ones
+struct Sample {
+    uint64_t value[EVENT_COUNT] = {};
+    uint64_t enabled = 0;
+    uint64_t running = 0;
+};
+
+// Opens the counters, false with Unavailable () telling why when the kernel,
+// the container or perf_event_paranoid does not allow them
+bool Start ();
+std::string const &Unavailable ();
+inline bool Started () { return started; }
+// Counters are open and the calling thread is the counted one
+bool Counting ();
+
+Sample Read ();
+void Add (char const *phase, Sample const &begin, Sample const &end);
+
+// Table of the phases in the order they first ran, closes the counters
+void Report (Logger const &l);
+}
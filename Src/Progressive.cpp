@@ -0,0 +1,181 @@
+#include "Progressive.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+uint32_t FloatBits (double value) {
+    float f = static_cast<float> (value);
+    uint32_t bits;
+    std::memcpy (&bits, &f, sizeof (bits));
+    return bits;
+}
+}
+
+void Progressive::Recorder::Add (uint32_t a, uint32_t b, Vec3 const &previous,
+                                 std::pmr::vector<uint32_t> const &removed, std::pmr::vector<uint32_t> const &changed) {
+    starts.push_back (data.size ());
+    data.insert (data.end (), {a, b, FloatBits (previous.x), FloatBits (previous.y), FloatBits (previous.z),
+                               static_cast<uint32_t> (removed.size () / 4), static_cast<uint32_t> (changed.size ())});
+    data.insert (data.end (), removed.begin (), removed.end ());
+    data.insert (data.end (), changed.begin (), changed.end ());
+}
+
+void Progressive::Recorder::Save (fs::path const &path, IndexedMesh const &mesh) const {
+    std::ofstream file (path, std::ios::binary);
+    if (!file.is_open ()) {
+        throw std::runtime_error ("Cannot create output file " + path.string ());
+    }
+
+    std::vector<uint32_t> baseFaces;
+    for (uint32_t f = 0; f < mesh.faces.size (); ++f) {
+        Face const &face = mesh.faces[f];
+        if (!face.Removed) {
+            baseFaces.insert (baseFaces.end (), {f, face.v1, face.v2, face.v3});
+        }
+    }
+
+    uint32_t header[5] = {static_cast<uint32_t> (mesh.vertices.size ()), static_cast<uint32_t> (mesh.faces.size ()),
+                          static_cast<uint32_t> (fullFaceCount), static_cast<uint32_t> (baseFaces.size () / 4),
+                          static_cast<uint32_t> (starts.size ())};
+    file.write (MAGIC, sizeof (MAGIC));
+    file.write (reinterpret_cast<const char *> (header), sizeof (header));
+
+    std::vector<uint32_t> positions;
+    positions.reserve (3 * mesh.vertices.size ());
+    for (Vertex const &v : mesh.vertices) {
+        positions.insert (positions.end (), {FloatBits (v.v.x), FloatBits (v.v.y), FloatBits (v.v.z)});
+    }
+    file.write (reinterpret_cast<const char *> (positions.data ()), positions.size () * sizeof (uint32_t));
+    file.write (reinterpret_cast<const char *> (baseFaces.data ()), baseFaces.size () * sizeof (uint32_t));
+
+    // Newest collapse first, so reading forward refines
+    for (size_t r = starts.size (); r-- > 0;) {
+        size_t end = r + 1 < starts.size () ? starts[r + 1] : data.size ();
+        file.write (reinterpret_cast<const char *> (data.data () + starts[r]), (end - starts[r]) * sizeof (uint32_t));
+    }
+    if (!file) {
+        throw std::runtime_error ("Error writing progressive mesh " + path.string ());
+    }
+}
+
+Progressive::Reader::Reader (fs::path const &path) : file (path, std::ios::binary) {
+    if (!file.is_open ()) {
+        throw std::runtime_error ("Cannot open file " + path.string ());
+    }
+
+    char magic[4];
+    uint32_t header[5];
+    Read (magic, sizeof (magic));
+    if (std::memcmp (magic, MAGIC, sizeof (MAGIC)) != 0) {
+        throw std::runtime_error ("Not a progressive mesh file " + path.string ());
+    }
+    Read (header, sizeof (header));
+    fullFaceCount = header[2];
+    remaining = header[4];
+    if (header[2] > header[1] || header[3] > header[1]) {
+        throw std::runtime_error ("Corrupt progressive mesh header in " + path.string ());
+    }
+
+    positions.resize (3 * static_cast<size_t> (header[0]));
+    Read (positions.data (), positions.size () * sizeof (float));
+
+    faces.resize (3 * static_cast<size_t> (header[1]));
+    alive.assign (header[1], 0);
+    std::vector<uint32_t> baseFaces (4 * static_cast<size_t> (header[3]));
+    Read (baseFaces.data (), baseFaces.size () * sizeof (uint32_t));
+    for (size_t i = 0; i < baseFaces.size (); i += 4) {
+        uint32_t f = baseFaces[i];
+        CheckFace (f, &baseFaces[i + 1]);
+        std::memcpy (&faces[3 * f], &baseFaces[i + 1], 3 * sizeof (uint32_t));
+        alive[f] = 1;
+    }
+    liveFaces = header[3];
+}
+
+void Progressive::Reader::Read (void *data, size_t size) {
+    file.read (reinterpret_cast<char *> (data), size);
+    if (!file) {
+        throw std::runtime_error ("Error reading progressive mesh");
+    }
+}
+
+void Progressive::Reader::CheckFace (uint32_t face, uint32_t const *vertices) const {
+    size_t vertexCount = positions.size () / 3;
+    if (face >= alive.size () || vertices[0] >= vertexCount || vertices[1] >= vertexCount || vertices[2] >= vertexCount) {
+        throw std::runtime_error ("Corrupt progressive mesh: face or vertex index out of range");
+    }
+}
+
+bool Progressive::Reader::Refine () {
+    if (remaining == 0) {
+        return false;
+    }
+    remaining--;
+
+    if (!headRead) {
+        Read (head, sizeof (head));
+    }
+    headRead = false;
+    uint32_t a = head[0], b = head[1];
+    // A split restores at most every face, the changed ones are live faces
+    if (a >= positions.size () / 3 || b >= positions.size () / 3 || head[5] > alive.size () || head[6] > alive.size ()) {
+        throw std::runtime_error ("Corrupt progressive mesh: vertex split out of range");
+    }
+    std::memcpy (&positions[3 * static_cast<size_t> (a)], &head[2], 3 * sizeof (float));
+
+    record.resize (4 * static_cast<size_t> (head[5]) + head[6]);
+    Read (record.data (), record.size () * sizeof (uint32_t));
+
+    uint32_t const *removed = record.data ();
+    for (size_t i = 0; i < head[5]; ++i, removed += 4) {
+        CheckFace (removed[0], removed + 1);
+        std::memcpy (&faces[3 * static_cast<size_t> (removed[0])], removed + 1, 3 * sizeof (uint32_t));
+        alive[removed[0]] = 1;
+    }
+    liveFaces += head[5];
+
+    for (uint32_t const *changed = removed; changed != record.data () + record.size (); ++changed) {
+        if (*changed >= alive.size ()) {
+            throw std::runtime_error ("Corrupt progressive mesh: face index out of range");
+        }
+        uint32_t *face = &faces[3 * static_cast<size_t> (*changed)];
+        for (size_t k = 0; k < 3; ++k) {
+            if (face[k] == a) {
+                face[k] = b;
+            }
+        }
+    }
+    return true;
+}
+
+void Progressive::Reader::RefineTo (size_t faceCount) {
+    while (liveFaces < faceCount && Refine ()) {
+    }
+}
+
+size_t Progressive::Reader::NextFaceCount () {
+    if (remaining == 0) {
+        return liveFaces;
+    }
+    if (!headRead) {
+        Read (head, sizeof (head));
+        headRead = true;
+    }
+    return liveFaces + head[5];
+}
+
+Mesh Progressive::Reader::Extract () const {
+    auto position = [this] (uint32_t v) {
+        float const *p = &positions[3 * static_cast<size_t> (v)];
+        return Vec3 (p[0], p[1], p[2]);
+    };
+
+    Mesh mesh;
+    mesh.reserve (liveFaces);
+    for (size_t f = 0; f < alive.size (); ++f) {
+        if (alive[f]) {
+            mesh.emplace_back (position (faces[3 * f]), position (faces[3 * f + 1]), position (faces[3 * f + 2]));
+        }
+    }
+    return mesh;
+}
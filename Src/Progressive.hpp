@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Geometry.hpp"
+#include "IndexedMesh.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Progressive mesh file: the simplified base mesh followed by vertex splits,
+// newest collapse first, that refine it back to the full mesh.
+//   header   "SPM1", vertexCount, faceCount, fullFaceCount, baseFaceCount, recordCount (uint32)
+//   vertexes float x, y, z per vertex. A collapsed vertex keeps the position it was removed at
+//   faces    face, v1, v2, v3 (uint32) per base face
+//   records  a, b, previous x, y, z of a (float), removedCount, changedCount,
+//            removedCount x (face, v1, v2, v3), changedCount x face
+// A split restores vertex a to its previous position, points the changed faces
+// back from a to b and revives the removed faces.
+namespace Progressive {
+static constexpr char MAGIC[4] = {'S', 'P', 'M', '1'};
+// a, b, previous x, y, z, removedCount, changedCount
+static constexpr size_t RECORD_HEADER = 7;
+
+// Collapse sequence of a Simplifier, packed in the file's record layout
+class Recorder {
+  public:
+    // fullFaceCount is the live face count when recording started
+    explicit Recorder (size_t fullFaceCount) : fullFaceCount (fullFaceCount) {}
+
+    void Add (uint32_t a, uint32_t b, Vec3 const &previous,
+              std::pmr::vector<uint32_t> const &removed, std::pmr::vector<uint32_t> const &changed);
+    size_t Count () const { return starts.size (); }
+    size_t Bytes () const { return data.capacity () * sizeof (uint32_t) + starts.capacity () * sizeof (size_t); }
+
+    void Save (fs::path const &path, IndexedMesh const &mesh) const;
+
+  private:
+    size_t fullFaceCount;
+    std::vector<uint32_t> data;
+    std::vector<size_t> starts;
+};
+
+// Streams the splits of a progressive mesh file, one record at a time
+class Reader {
+  public:
+    explicit Reader (fs::path const &path);
+
+    size_t FaceCount () const { return liveFaces; }
+    size_t FullFaceCount () const { return fullFaceCount; }
+
+    // Apply the next split, false once the full mesh is restored
+    bool Refine ();
+    // Refine until at least faceCount faces are live
+    void RefineTo (size_t faceCount);
+    // Live faces after the next split, FaceCount () once the full mesh is restored
+    size_t NextFaceCount ();
+    Mesh Extract () const;
+
+  private:
+    std::ifstream file;
+    size_t remaining = 0;
+    size_t liveFaces = 0;
+    size_t fullFaceCount = 0;
+    std::vector<float> positions;
+    std::vector<uint32_t> faces;
+    std::vector<uint8_t> alive;
+    std::vector<uint32_t> record;
+    uint32_t head[RECORD_HEADER];
+    bool headRead = false;
+
+    void Read (void *data, size_t size);
+    // Throws unless the indices of a face are within the header's counts
+    void CheckFace (uint32_t face, uint32_t const *vertices) const;
+};
+}
@@ -1,25 +1,118 @@
 #include "STL.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
-#include <iosfwd>
-#include <sstream>
+#include <string_view>
 
-std::vector<double> STL::parseFloats (const std::vector<std::string> &items) {
-    std::vector<double> result;
-    result.reserve (items.size ());
+namespace {
+// Chunks of a parallel ASCII parse are at least this many bytes
+constexpr size_t ASCII_CHUNK = 1 << 20;
+// Triangles encoded per write of SaveBinary, 50 MB
+constexpr size_t WRITE_BLOCK = 1 << 20;
 
-    for (const auto &item : items) {
-        std::istringstream iss (item);
-        double f;
-        iss >> f;
-        result.push_back (f);
+bool IsSpace (char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// Word at pos, pos is moved past it
+std::string_view NextWord (char const *&pos, char const *end) {
+    while (pos < end && IsSpace (*pos)) {
+        pos++;
     }
+    char const *begin = pos;
+    while (pos < end && !IsSpace (*pos)) {
+        pos++;
+    }
+    return std::string_view (begin, pos - begin);
+}
 
-    return result;
+bool ParseDouble (std::string_view word, double &value) {
+    if (!word.empty () && word[0] == '+') {
+        word.remove_prefix (1);
+    }
+#ifdef __cpp_lib_to_chars
+    auto [end, error] = std::from_chars (word.data (), word.data () + word.size (), value);
+    return error == std::errc () && end == word.data () + word.size ();
+#else
+    // No floating point from_chars in this standard library, strtod needs a terminated copy
+    char buffer[64];
+    if (word.empty () || word.size () >= sizeof (buffer)) {
+        return false;
+    }
+    std::memcpy (buffer, word.data (), word.size ());
+    buffer[word.size ()] = 0;
+    char *end;
+    value = std::strtod (buffer, &end);
+    return end == buffer + word.size ();
+#endif
 }
 
-Mesh STL::LoadBinary (fs::path const &path) {
-    std::ifstream file (path, std::ios::binary);
+// Vertexes of the "vertex x y z" lines in [pos, end)
+bool ParseVertexes (char const *pos, char const *end, std::vector<Vec3> &vertexes) {
+    for (std::string_view word = NextWord (pos, end); !word.empty (); word = NextWord (pos, end)) {
+        if (word != "vertex") {
+            continue;
+        }
+        double c[3];
+        for (double &value : c) {
+            if (!ParseDouble (NextWord (pos, end), value)) {
+                return false;
+            }
+        }
+        vertexes.emplace_back (c[0], c[1], c[2]);
+    }
+    return true;
+}
+
+// First position after the next "endfacet" at or after pos
+char const *NextFacet (char const *pos, char const *end) {
+    std::string_view rest (pos, end - pos);
+    size_t found = rest.find ("endfacet");
+    return found == std::string_view::npos ? end : pos + found + std::strlen ("endfacet");
+}
+}
+
+Mesh STL::LoadBinary (fs::path const &path, size_t threads) {
+    Trace::Scope trace ("STL::LoadBinary");
+    MappedFile file (path);
+    if (file.Size () < HEADER_SIZE) {
+        throw std::runtime_error ("Error reading STL header");
+    }
+
+    Header header;
+    std::memcpy (&header, file.Data (), HEADER_SIZE);
+    if (file.Size () < HEADER_SIZE + static_cast<size_t> (header.Count) * TRIANGLE_SIZE) {
+        throw std::runtime_error ("Error reading STL triangle");
+    }
+
+    // Records have a fixed stride, every chunk decodes straight into its own part of the mesh
+    Mesh mesh (header.Count);
+    char const *records = file.Data () + HEADER_SIZE;
+    ThreadPool pool (threads);
+    pool.ParallelFor (mesh.size (), [&mesh, records] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float v[9];
+            std::memcpy (v, records + i * TRIANGLE_SIZE + sizeof (Triangle::N), sizeof (v));
+            mesh[i] = ::Triangle (Vec3 (v[0], v[1], v[2]), Vec3 (v[3], v[4], v[5]), Vec3 (v[6], v[7], v[8]));
+        }
+    }, 16384);
+
+    return mesh;
+}
+
+void STL::SaveBinary (fs::path const &path, Mesh const &mesh, size_t threads) {
+    Trace::Scope trace ("STL::SaveBinary");
+    BinaryWriter writer (path, threads);
+    writer.Append (mesh);
+    writer.Finish ();
+}
+
+STL::BinaryReader::BinaryReader (fs::path const &path) : file (path, std::ios::binary) {
     if (!file.is_open ()) {
         throw std::runtime_error ("Cannot open file " + path.string ());
     }
@@ -29,92 +122,152 @@ Mesh STL::LoadBinary (fs::path const &path) {
     if (!file) {
         throw std::runtime_error ("Error reading STL header");
     }
+    count = header.Count;
+    if (fs::file_size (path) < HEADER_SIZE + count * TRIANGLE_SIZE) {
+        throw std::runtime_error ("Error reading STL triangle");
+    }
+}
 
-    Mesh mesh;
-    mesh.reserve (header.Count);
+bool STL::BinaryReader::Read (Mesh &mesh, size_t maxCount) {
+    size_t n = std::min (maxCount, count - position);
+    mesh.resize (n);
+    if (n == 0) {
+        return false;
+    }
 
-    for (size_t i = 0; i < header.Count; ++i) {
-        Triangle d;
-        file.read (reinterpret_cast<char *> (&d), TRIANGLE_SIZE);
-        if (!file) {
-            throw std::runtime_error ("Error reading STL triangle");
-        }
-        mesh.emplace_back (
-            Vec3 (d.v1[0], d.v1[1], d.v1[2]),
-            Vec3 (d.v2[0], d.v2[1], d.v2[2]),
-            Vec3 (d.v3[0], d.v3[1], d.v3[2]));
+    buffer.resize (n * TRIANGLE_SIZE);
+    file.read (buffer.data (), buffer.size ());
+    if (!file) {
+        throw std::runtime_error ("Error reading STL triangle");
+    }
+    for (size_t i = 0; i < n; ++i) {
+        float v[9];
+        std::memcpy (v, buffer.data () + i * TRIANGLE_SIZE + sizeof (Triangle::N), sizeof (v));
+        mesh[i] = ::Triangle (Vec3 (v[0], v[1], v[2]), Vec3 (v[3], v[4], v[5]), Vec3 (v[6], v[7], v[8]));
     }
+    position += n;
+    return true;
+}
 
-    return mesh;
+void STL::BinaryReader::Rewind () {
+    file.clear ();
+    file.seekg (HEADER_SIZE);
+    position = 0;
 }
 
-void STL::SaveBinary (fs::path const &path, Mesh const &mesh) {
-    std::ofstream file (path, std::ios::binary);
+STL::BinaryWriter::BinaryWriter (fs::path const &path, size_t threads) : file (path, std::ios::binary), pool (threads) {
     if (!file.is_open ()) {
         throw std::runtime_error ("Cannot create output file " + path.string ());
     }
 
+    // The count is a placeholder until Finish
     Header header{};
-    header.Count = static_cast<uint32_t> (mesh.size ());
-
     const char *text = "Saved by Simplifier @MicroKiss";
     std::memcpy (header._, text, std::min (strlen (text), sizeof (header._)));
     file.write (reinterpret_cast<const char *> (&header), HEADER_SIZE);
     if (!file) {
         throw std::runtime_error ("Error writing STL header");
     }
+}
+
+void STL::BinaryWriter::Append (Mesh const &mesh) {
+    buffer.resize (std::min (mesh.size (), WRITE_BLOCK) * TRIANGLE_SIZE);
+    for (size_t first = 0; first < mesh.size (); first += WRITE_BLOCK) {
+        size_t size = std::min (mesh.size () - first, WRITE_BLOCK);
+        pool.ParallelFor (size, [this, &mesh, first] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                ::Triangle const &triangle = mesh[first + i];
+                Vec3 n = triangle.Normal ();
+                float d[12] = {
+                    static_cast<float> (n.x), static_cast<float> (n.y), static_cast<float> (n.z),
+                    static_cast<float> (triangle.v1.x), static_cast<float> (triangle.v1.y), static_cast<float> (triangle.v1.z),
+                    static_cast<float> (triangle.v2.x), static_cast<float> (triangle.v2.y), static_cast<float> (triangle.v2.z),
+                    static_cast<float> (triangle.v3.x), static_cast<float> (triangle.v3.y), static_cast<float> (triangle.v3.z)};
+                char *record = buffer.data () + i * TRIANGLE_SIZE;
+                std::memcpy (record, d, sizeof (d));
+                std::memset (record + sizeof (d), 0, sizeof (uint16_t));
+            }
+        }, 16384);
 
-    for (const ::Triangle &triangle : mesh) {
-        Vec3 n = triangle.Normal ();
-        Triangle d;
-        d.N[0] = static_cast<float> (n.x);
-        d.N[1] = static_cast<float> (n.y);
-        d.N[2] = static_cast<float> (n.z);
-        d.v1[0] = static_cast<float> (triangle.v1.x);
-        d.v1[1] = static_cast<float> (triangle.v1.y);
-        d.v1[2] = static_cast<float> (triangle.v1.z);
-        d.v2[0] = static_cast<float> (triangle.v2.x);
-        d.v2[1] = static_cast<float> (triangle.v2.y);
-        d.v2[2] = static_cast<float> (triangle.v2.z);
-        d.v3[0] = static_cast<float> (triangle.v3.x);
-        d.v3[1] = static_cast<float> (triangle.v3.y);
-        d.v3[2] = static_cast<float> (triangle.v3.z);
-        file.write (reinterpret_cast<const char *> (&d), TRIANGLE_SIZE);
+        file.write (buffer.data (), size * TRIANGLE_SIZE);
         if (!file) {
             throw std::runtime_error ("Error writing STL triangle");
         }
     }
+    count += mesh.size ();
 }
 
-Mesh STL::LoadASCII (fs::path const &path) {
-    std::ifstream file (path);
-    if (!file.is_open ()) {
-        throw std::runtime_error ("Cannot open file " + path.string ());
+void STL::BinaryWriter::Finish () {
+    uint32_t header = static_cast<uint32_t> (count);
+    file.seekp (HEADER_SIZE - sizeof (header));
+    file.write (reinterpret_cast<const char *> (&header), sizeof (header));
+    file.close ();
+    if (!file) {
+        throw std::runtime_error ("Error writing STL header");
+    }
+}
+
+bool STL::IsASCII (char const *data, size_t size) {
+    // Binary files may start with "solid" too, trust a matching record count first
+    if (size >= HEADER_SIZE) {
+        Header header;
+        std::memcpy (&header, data, HEADER_SIZE);
+        if (size == HEADER_SIZE + static_cast<size_t> (header.Count) * TRIANGLE_SIZE) {
+            return false;
+        }
+    }
+    char const *pos = data;
+    return NextWord (pos, data + size) == "solid";
+}
+
+Mesh STL::Load (fs::path const &path, size_t threads) {
+    bool ascii;
+    {
+        MappedFile file (path);
+        ascii = IsASCII (file.Data (), file.Size ());
     }
+    return ascii ? LoadASCII (path, threads) : LoadBinary (path, threads);
+}
 
-    std::vector<Vec3> vertexes;
-    std::string line;
-    while (std::getline (file, line)) {
-        std::istringstream iss (line);
-        std::vector<std::string> fields;
-        std::string field;
-        while (iss >> field) {
-            fields.push_back (field);
+Mesh STL::LoadASCII (fs::path const &path, size_t threads) {
+    Trace::Scope trace ("STL::LoadASCII");
+    MappedFile file (path);
+    char const *data = file.Data ();
+    char const *end = data + file.Size ();
+
+    // Split after "endfacet" so every chunk holds whole facets
+    ThreadPool pool (threads);
+    size_t chunkCount = std::max<size_t> (1, std::min (4 * pool.Size (), file.Size () / ASCII_CHUNK));
+    std::vector<char const *> bounds{data};
+    for (size_t i = 1; i < chunkCount; ++i) {
+        char const *pos = std::max (bounds.back (), data + i * (file.Size () / chunkCount));
+        bounds.push_back (NextFacet (pos, end));
+    }
+    bounds.push_back (end);
+
+    std::vector<std::vector<Vec3>> vertexes (chunkCount);
+    std::vector<uint8_t> valid (chunkCount, 0);
+    pool.ParallelFor (chunkCount, [&bounds, &vertexes, &valid] (size_t begin, size_t last) {
+        for (size_t i = begin; i < last; ++i) {
+            vertexes[i].reserve ((bounds[i + 1] - bounds[i]) / 64);
+            valid[i] = ParseVertexes (bounds[i], bounds[i + 1], vertexes[i]);
         }
-        if (fields.size () == 4 && fields[0] == "vertex") {
-            std::vector<double> f = parseFloats ({fields.begin () + 1, fields.end ()});
-            Vec3 v (f[0], f[1], f[2]);
-            vertexes.push_back (v);
+    }, 1);
+
+    size_t count = 0;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        if (!valid[i] || vertexes[i].size () % 3 != 0) {
+            throw std::runtime_error ("Error parsing STL vertex in " + path.string ());
         }
+        count += vertexes[i].size ();
     }
 
     Mesh mesh;
-    mesh.reserve (vertexes.size ());
-    for (size_t i = 0; i < vertexes.size (); i += 3) {
-        mesh.emplace_back (
-            vertexes[i + 0],
-            vertexes[i + 1],
-            vertexes[i + 2]);
+    mesh.reserve (count / 3);
+    for (std::vector<Vec3> const &chunk : vertexes) {
+        for (size_t i = 0; i < chunk.size (); i += 3) {
+            mesh.emplace_back (chunk[i + 0], chunk[i + 1], chunk[i + 2]);
+        }
     }
 
     return mesh;
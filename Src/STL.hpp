@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Geometry.hpp"
+#include "ThreadPool.hpp"
 #include <filesystem>
+#include <fstream>
 
 namespace fs = std::filesystem;
 namespace STL {
@@ -21,9 +23,46 @@ static constexpr size_t TRIANGLE_SIZE = 12 * sizeof (float) + sizeof (uint16_t);
 static_assert (HEADER_SIZE == 84, "Invalid STL header size");
 static_assert (TRIANGLE_SIZE == 50, "Invalid STL triangle size");
 
-std::vector<double> parseFloats (const std::vector<std::string> &items);
+// Maps the file and decodes the records on threads (0 = all cores)
+Mesh LoadBinary (fs::path const &path, size_t threads = 1);
+// Encodes blocks of records on threads (0 = all cores), writes each block at once
+void SaveBinary (fs::path const &path, Mesh const &mesh, size_t threads = 1);
+// Parses chunks split at facet boundaries on threads (0 = all cores)
+Mesh LoadASCII (fs::path const &path, size_t threads = 1);
+// Binary or ASCII, whichever the file contains
+Mesh Load (fs::path const &path, size_t threads = 1);
+bool IsASCII (char const *data, size_t size);
 
-Mesh LoadBinary (fs::path const &path);
-void SaveBinary (fs::path const &path, Mesh const &mesh);
-Mesh LoadASCII (fs::path const &path);
+// Reads a binary STL a block of triangles at a time
+class BinaryReader {
+  public:
+    explicit BinaryReader (fs::path const &path);
+
+    size_t Count () const { return count; }
+    // Replace mesh by the next at most maxCount triangles, false once all were read
+    bool Read (Mesh &mesh, size_t maxCount);
+    void Rewind ();
+
+  private:
+    std::ifstream file;
+    size_t count = 0;
+    size_t position = 0;
+    std::vector<char> buffer;
+};
+
+// Appends blocks of triangles to a binary STL, Finish writes the final count into the header
+class BinaryWriter {
+  public:
+    explicit BinaryWriter (fs::path const &path, size_t threads = 1);
+
+    size_t Count () const { return count; }
+    void Append (Mesh const &mesh);
+    void Finish ();
+
+  private:
+    std::ofstream file;
+    ThreadPool pool;
+    size_t count = 0;
+    std::vector<char> buffer;
+};
 }
\ No newline at end of file
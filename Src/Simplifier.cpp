@@ -0,0 +1,461 @@
+#include "Simplifier.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+
+namespace {
+// Typical valences stay far below this, larger ones grow the buffers once
+constexpr size_t SCRATCH_CAPACITY = 256;
+// A round collapses at most 1 / ROUND_FRACTION of the faces
+constexpr size_t ROUND_FRACTION = 100;
+// and looks at most ROUND_WINDOW times as many edges as it may collapse
+constexpr size_t ROUND_WINDOW = 4;
+// Sample the queue for the trace and check the memory limit every CHECK_INTERVAL collapses
+constexpr size_t CHECK_INTERVAL = 4096;
+// Poll the time budget, cancellation and progress every POLL_INTERVAL collapses
+constexpr size_t POLL_INTERVAL = 256;
+}
+
+Simplifier::Scratch::Scratch (std::pmr::memory_resource *resource)
+    : faces (resource), edges (resource), newFaces (resource), newEdges (resource), neighbors (resource), droppedEdges (resource),
+      removed (resource), changed (resource) {
+    faces.reserve (SCRATCH_CAPACITY);
+    edges.reserve (SCRATCH_CAPACITY);
+    newFaces.reserve (SCRATCH_CAPACITY);
+    newEdges.reserve (SCRATCH_CAPACITY);
+    neighbors.reserve (SCRATCH_CAPACITY);
+    droppedEdges.reserve (SCRATCH_CAPACITY);
+}
+
+void Simplifier::Scratch::Clear () {
+    faces.clear ();
+    edges.clear ();
+    newFaces.clear ();
+    newEdges.clear ();
+    neighbors.clear ();
+    droppedEdges.clear ();
+    removed.clear ();
+    changed.clear ();
+    removedFaces = 0;
+}
+
+size_t Simplifier::Scratch::Bytes () const {
+    size_t capacity = faces.capacity () + edges.capacity () + newFaces.capacity () + newEdges.capacity () + neighbors.capacity () +
+                      droppedEdges.capacity () + removed.capacity () + changed.capacity ();
+    return sizeof (Scratch) + capacity * sizeof (uint32_t);
+}
+
+Simplifier::Simplifier (Mesh const &input, SimplifyOptions const &options, std::vector<bool> const &lockedCorners)
+    : pool (options.threads),
+      mesh (CreateIndexedMesh (input, options, pool, lockedCorners)),
+      queue (mesh.Resource ()),
+      numFaces (mesh.faces.size ()),
+      memoryLimit (options.memoryLimit),
+      scratch (mesh.Resource ()),
+      claimed (mesh.Resource ()),
+      selected (mesh.Resource ()),
+      rejected (mesh.Resource ()) {
+    Trace::Scope trace ("BuildQueue");
+    // Enqueue edges, a collapse re-prioritizes the edges it touches in place
+    std::pmr::vector<double> errors (mesh.edges.size (), mesh.Resource ());
+    pool.ParallelFor (mesh.edges.size (), [this, &errors] (size_t begin, size_t end) {
+        for (size_t e = begin; e < end; ++e) {
+            errors[e] = mesh.edges[e].UpdateError (mesh.vertices);
+        }
+    });
+    queue.Build (errors);
+
+    if (!mesh.locked.empty ()) {
+        for (uint32_t e = 0; e < mesh.edges.size (); ++e) {
+            Edge &edge = mesh.edges[e];
+            if (mesh.locked[edge.A] || mesh.locked[edge.B]) {
+                edge.Removed = true;
+                queue.Remove (e);
+            }
+        }
+    }
+    if (memoryLimit) {
+        CheckMemory ();
+    }
+}
+
+void Simplifier::Run (size_t targetFaces) {
+    StopCriteria stop;
+    stop.targetFaces = targetFaces;
+    Run (stop);
+}
+
+StopReason Simplifier::Run (StopCriteria const &stop) {
+    auto start = std::chrono::steady_clock::now ();
+    size_t arenaAllocations = mesh.arena->Stats ().allocations;
+    Trace::Scope trace ("Collapse");
+
+    StopReason reason = StopReason::Exhausted;
+    for (size_t popped = 1; !queue.Empty (); ++popped) {
+        if (numFaces <= stop.targetFaces) {
+            reason = StopReason::Target;
+            break;
+        }
+        if (queue.TopPriority () > stop.maxError) {
+            reason = StopReason::Error;
+            break;
+        }
+        Collapse (queue.Pop ());
+        if (popped % POLL_INTERVAL == 0 && Interrupted (stop, start, reason)) {
+            break;
+        }
+        if (popped % CHECK_INTERVAL == 0) {
+            if (Trace::Enabled ()) {
+                Trace::Counter ("Simplifier", {{"faces", double (numFaces)}, {"queue", double (queue.Size ())}});
+            }
+            if (memoryLimit) {
+                CheckMemory ();
+            }
+        }
+    }
+
+    collapseAllocations += mesh.arena->Stats ().allocations - arenaAllocations;
+    return reason;
+}
+
+bool Simplifier::Interrupted (StopCriteria const &stop, std::chrono::steady_clock::time_point start, StopReason &reason) const {
+    if (stop.cancel && stop.cancel->load (std::memory_order_relaxed)) {
+        reason = StopReason::Cancelled;
+        return true;
+    }
+    if (stop.timeBudget <= 0 && !stop.progress) {
+        return false;
+    }
+    double seconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+    if (stop.timeBudget > 0 && seconds >= stop.timeBudget) {
+        reason = StopReason::Time;
+        return true;
+    }
+    if (stop.progress && !stop.progress (Progress{numFaces, queue.Empty () ? 0.0 : queue.TopPriority (), seconds})) {
+        reason = StopReason::Cancelled;
+        return true;
+    }
+    return false;
+}
+
+bool Simplifier::Collapse (uint32_t edge) {
+    if (!Prepare (edge, scratch)) {
+        return false;
+    }
+    Apply (scratch);
+    Commit (scratch);
+    return true;
+}
+
+bool Simplifier::Prepare (uint32_t edge, Scratch &s) {
+    std::pmr::vector<Vertex> const &vertices = mesh.vertices;
+    std::pmr::vector<Face> const &faces = mesh.faces;
+    std::pmr::vector<Edge> &edges = mesh.edges;
+    s.Clear ();
+
+    Edge &p = edges[edge];
+    p.Removed = true;
+    s.a = p.A;
+    s.b = p.B;
+    uint32_t const a = s.a;
+    uint32_t const b = s.b;
+
+    // Get related faces, faces shared by A and B are listed once
+    for (uint32_t f : mesh.vertexFaces.Get (a)) {
+        if (!faces[f].Removed) {
+            s.faces.push_back (f);
+        }
+    }
+    s.firstFaceOfB = s.faces.size ();
+    for (uint32_t f : mesh.vertexFaces.Get (b)) {
+        if (!faces[f].Removed && !faces[f].Contains (a)) {
+            s.faces.push_back (f);
+        }
+    }
+
+    // Get related edges
+    for (uint32_t q : mesh.vertexEdges.Get (a)) {
+        if (!edges[q].Removed) {
+            s.edges.push_back (q);
+        }
+    }
+    for (uint32_t q : mesh.vertexEdges.Get (b)) {
+        if (!edges[q].Removed) {
+            s.edges.push_back (q);
+        }
+    }
+
+    // Create the new vertex, it takes the place of A
+    s.vertex = p.ComputeNewVertex (vertices);
+
+    // Reject the collapse if any remaining face would flip
+    for (uint32_t f : s.faces) {
+        Face const &face = faces[f];
+        Triangle before = face.ToTriangle (vertices);
+        Triangle after = before;
+        if (face.v1 == a || face.v1 == b) {
+            after.v1 = s.vertex.v;
+        }
+        if (face.v2 == a || face.v2 == b) {
+            after.v2 = s.vertex.v;
+        }
+        if (face.v3 == a || face.v3 == b) {
+            after.v3 = s.vertex.v;
+        }
+        if (after.Degenerate ()) {
+            continue;
+        }
+        if (after.Normal ().Dot (before.Normal ()) < EPSILON) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Simplifier::Apply (Scratch &s) {
+    std::pmr::vector<Vertex> &vertices = mesh.vertices;
+    std::pmr::vector<Face> &faces = mesh.faces;
+    std::pmr::vector<Edge> &edges = mesh.edges;
+    uint32_t const a = s.a;
+    uint32_t const b = s.b;
+
+    // Update faces
+    s.previous = vertices[a].v;
+    vertices[a] = s.vertex;
+    for (size_t i = 0; i < s.faces.size (); ++i) {
+        uint32_t f = s.faces[i];
+        Face &face = faces[f];
+        Face const before = face;
+        face.Replace (b, a);
+        if (face.ToTriangle (vertices).Degenerate ()) {
+            face.Removed = true;
+            s.removedFaces++;
+            if (recorder) {
+                s.removed.insert (s.removed.end (), {f, before.v1, before.v2, before.v3});
+            }
+            continue;
+        }
+        s.newFaces.push_back (f);
+        if (recorder && i >= s.firstFaceOfB) {
+            s.changed.push_back (f);
+        }
+    }
+
+    // Update edges, an edge of B that duplicates an edge of A is dropped
+    for (uint32_t q : s.edges) {
+        Edge &e = edges[q];
+        uint32_t other = (e.A == a || e.A == b) ? e.B : e.A;
+        if (std::find (s.neighbors.begin (), s.neighbors.end (), other) != s.neighbors.end ()) {
+            e.Removed = true;
+            s.droppedEdges.push_back (q);
+            continue;
+        }
+        s.neighbors.push_back (other);
+
+        e = Edge (a, other);
+        e.UpdateError (vertices);
+        s.newEdges.push_back (q);
+    }
+}
+
+void Simplifier::Commit (Scratch &s) {
+    numFaces -= s.removedFaces;
+    mesh.vertexFaces.Assign (s.a, s.newFaces);
+    mesh.vertexFaces.Clear (s.b);
+    mesh.vertexEdges.Assign (s.a, s.newEdges);
+    mesh.vertexEdges.Clear (s.b);
+    for (uint32_t q : s.droppedEdges) {
+        queue.Remove (q);
+    }
+    for (uint32_t q : s.newEdges) {
+        queue.Update (q, mesh.edges[q].CachedError);
+    }
+    if (recorder) {
+        recorder->Add (s.a, s.b, s.previous, s.removed, s.changed);
+    }
+}
+
+void Simplifier::RunRounds (size_t targetFaces) {
+    StopCriteria stop;
+    stop.targetFaces = targetFaces;
+    RunRounds (stop);
+}
+
+StopReason Simplifier::RunRounds (StopCriteria const &stop) {
+    auto start = std::chrono::steady_clock::now ();
+    size_t arenaAllocations = mesh.arena->Stats ().allocations;
+    if (claimed.empty ()) {
+        claimed.assign (mesh.vertices.size (), 0);
+    }
+
+    Trace::Scope trace ("CollapseRounds");
+
+    StopReason reason = StopReason::Exhausted;
+    while (!queue.Empty ()) {
+        if (numFaces <= stop.targetFaces) {
+            reason = StopReason::Target;
+            break;
+        }
+        if (queue.TopPriority () > stop.maxError) {
+            reason = StopReason::Error;
+            break;
+        }
+        if (Interrupted (stop, start, reason)) {
+            break;
+        }
+        Trace::Scope roundTrace ("Round");
+        // A collapse removes about two faces, stay clear of overshooting the target
+        size_t batch = std::max<size_t> (1, std::min ((numFaces - stop.targetFaces) / 4, numFaces / ROUND_FRACTION));
+
+        // Take the cheapest edges whose neighborhoods are still free, put the others back
+        round++;
+        selected.clear ();
+        rejected.clear ();
+        for (size_t popped = 0; selected.size () < batch && popped < ROUND_WINDOW * batch && !queue.Empty () && queue.TopPriority () <= stop.maxError;
+             ++popped) {
+            uint32_t e = queue.Pop ();
+            (Claim (e) ? selected : rejected).push_back (e);
+        }
+        for (uint32_t e : rejected) {
+            queue.Push (e, mesh.edges[e].CachedError);
+        }
+
+        while (roundScratch.size () < selected.size ()) {
+            roundScratch.emplace_back (mesh.Resource ());
+        }
+
+        // The neighborhoods are disjoint, the collapses and their cost updates run without locks
+        pool.ParallelFor (selected.size (), [this] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Scratch &s = roundScratch[i];
+                s.valid = Prepare (selected[i], s);
+                if (s.valid) {
+                    Apply (s);
+                }
+            }
+        }, 16);
+
+        for (size_t i = 0; i < selected.size (); ++i) {
+            if (roundScratch[i].valid) {
+                Commit (roundScratch[i]);
+            }
+        }
+        if (Trace::Enabled ()) {
+            Trace::Counter ("Simplifier", {{"faces", double (numFaces)}, {"queue", double (queue.Size ())}, {"batch", double (selected.size ())}});
+        }
+        if (memoryLimit) {
+            CheckMemory ();
+        }
+    }
+
+    collapseAllocations += mesh.arena->Stats ().allocations - arenaAllocations;
+    return reason;
+}
+
+// Claim the one-ring of both endpoints for this round, fails if any of it is taken
+bool Simplifier::Claim (uint32_t edge) {
+    Edge const &p = mesh.edges[edge];
+    auto visitRing = [this, &p] (auto &&visit) {
+        for (uint32_t v : {p.A, p.B}) {
+            for (uint32_t f : mesh.vertexFaces.Get (v)) {
+                Face const &face = mesh.faces[f];
+                if (!face.Removed && (!visit (face.v1) || !visit (face.v2) || !visit (face.v3))) {
+                    return false;
+                }
+            }
+            for (uint32_t q : mesh.vertexEdges.Get (v)) {
+                Edge const &e = mesh.edges[q];
+                if (!e.Removed && (!visit (e.A) || !visit (e.B))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    if (!visitRing ([this] (uint32_t v) { return claimed[v] != round; })) {
+        return false;
+    }
+    visitRing ([this] (uint32_t v) {
+        claimed[v] = round;
+        return true;
+    });
+    return true;
+}
+
+void Simplifier::Record () {
+    recorder = std::make_unique<Progressive::Recorder> (numFaces);
+}
+
+void Simplifier::SaveProgressive (fs::path const &path) const {
+    if (recorder) {
+        recorder->Save (path, mesh);
+    } else {
+        Progressive::Recorder (numFaces).Save (path, mesh);
+    }
+}
+
+Mesh Simplifier::Result () const {
+    return ConstructMesh (mesh);
+}
+
+std::vector<bool> Simplifier::LockedCorners () const {
+    std::vector<bool> corners;
+    corners.reserve (3 * numFaces);
+    for (Face const &f : mesh.faces) {
+        if (!f.Removed) {
+            bool locked = !mesh.locked.empty ();
+            corners.push_back (locked && mesh.locked[f.v1]);
+            corners.push_back (locked && mesh.locked[f.v2]);
+            corners.push_back (locked && mesh.locked[f.v3]);
+        }
+    }
+    return corners;
+}
+
+// Sum of the quadric errors of the remaining vertices, the deviation from the input planes
+double Simplifier::QuadricErrorSum () const {
+    std::pmr::vector<uint8_t> seen (mesh.vertices.size (), 0, mesh.Resource ());
+    double sum = 0;
+    for (Face const &f : mesh.faces) {
+        if (f.Removed) {
+            continue;
+        }
+        for (uint32_t v : {f.v1, f.v2, f.v3}) {
+            if (!seen[v]) {
+                seen[v] = 1;
+                sum += mesh.vertices[v].q.Error (mesh.vertices[v].v);
+            }
+        }
+    }
+    return sum;
+}
+
+SimplifyStats Simplifier::Stats () const {
+    SimplifyStats stats;
+    stats.arena = mesh.arena->Stats ();
+    stats.collapseAllocations = collapseAllocations;
+    stats.quadricError = QuadricErrorSum ();
+    stats.memory = Memory ();
+    return stats;
+}
+
+MemoryUsage Simplifier::Memory () const {
+    MemoryUsage memory;
+    memory.vertices = mesh.vertices.capacity () * sizeof (Vertex);
+    memory.faces = mesh.faces.capacity () * sizeof (Face);
+    memory.edges = mesh.edges.capacity () * sizeof (Edge);
+    memory.adjacency = mesh.vertexFaces.Bytes () + mesh.vertexEdges.Bytes ();
+    memory.queue = queue.Bytes ();
+    memory.scratch = scratch.Bytes () + mesh.locked.capacity () +
+                     (claimed.capacity () + selected.capacity () + rejected.capacity ()) * sizeof (uint32_t);
+    for (Scratch const &s : roundScratch) {
+        memory.scratch += s.Bytes ();
+    }
+    memory.recorder = recorder ? recorder->Bytes () : 0;
+    return memory;
+}
+
+// The collapse loop itself does not allocate, the records and the round buffers grow
+void Simplifier::CheckMemory () const {
+    CheckMemoryLimit (Memory ().Total (), memoryLimit, "Simplifier with " + std::to_string (numFaces) + " faces left");
+}
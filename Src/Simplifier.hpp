@@ -0,0 +1,119 @@
+#pragma once
+
+#include "IndexedHeap.hpp"
+#include "IndexedMesh.hpp"
+#include "Progressive.hpp"
+#include "Simplify.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <memory>
+
+enum class StopReason { Target,    // targetFaces reached
+                        Error,     // the cheapest collapse costs more than maxError
+                        Time,      // timeBudget used up
+                        Cancelled, // cancel set or progress returned false
+                        Exhausted  // no edge left that can be collapsed
+};
+
+struct Progress {
+    size_t faces;
+    double error;   // quadric error of the next collapse
+    double seconds; // since the run started
+};
+
+// A run stops at whichever criterion is met first. Faces and error are checked before
+// every collapse, the time budget, cancel and progress every POLL_INTERVAL collapses
+// (a fraction of a millisecond) or once per round in RunRounds.
+struct StopCriteria {
+    size_t targetFaces = 0;
+    double maxError = std::numeric_limits<double>::infinity ();
+    double timeBudget = 0; // seconds from the start of the run, setup not included, 0 = unlimited
+    std::atomic<bool> const *cancel = nullptr;
+    // Returning false cancels the run
+    std::function<bool (Progress const &)> progress;
+};
+
+// Collapse state of one mesh: the indexed mesh, the edge queue and the scratch
+// buffers every collapse reuses. Once the buffers reached the largest vertex
+// valence the collapse loop runs without allocating.
+class Simplifier {
+  public:
+    // Edges touching a vertex with a set lockedCorners flag (3 per triangle) are never collapsed
+    explicit Simplifier (Mesh const &input, SimplifyOptions const &options = {}, std::vector<bool> const &lockedCorners = {});
+
+    // Collapse edges until at most targetFaces faces are left or no edge can be collapsed
+    void Run (size_t targetFaces);
+    // Collapse edges, cheapest first, until stop is met. Runs may continue each other,
+    // the result is valid after every one of them.
+    StopReason Run (StopCriteria const &stop);
+    // Same, in rounds: each round collapses a batch of cheap edges with disjoint
+    // neighborhoods concurrently. Trades strict greedy order for threads.
+    void RunRounds (size_t targetFaces);
+    StopReason RunRounds (StopCriteria const &stop);
+
+    // Record the collapses of the following runs, SaveProgressive can then
+    // refine the result back to the current mesh
+    void Record ();
+    void SaveProgressive (fs::path const &path) const;
+
+    size_t FaceCount () const { return numFaces; }
+    Mesh Result () const;
+    // Per corner of Result (): whether the vertex is locked
+    std::vector<bool> LockedCorners () const;
+    double QuadricErrorSum () const;
+    SimplifyStats Stats () const;
+    MemoryUsage Memory () const;
+
+  private:
+    ThreadPool pool;
+    IndexedMesh mesh;
+    IndexedHeap queue;
+    size_t numFaces = 0;
+    size_t memoryLimit = 0;
+    size_t collapseAllocations = 0;
+    std::unique_ptr<Progressive::Recorder> recorder;
+
+    // One collapse in flight. Prepare and Apply only touch the faces, edges and vertexes
+    // around the edge, Commit updates the shared adjacency and queue.
+    struct Scratch {
+        uint32_t a = 0;
+        uint32_t b = 0;
+        Vertex vertex;
+        bool valid = false;
+        size_t removedFaces = 0;
+        // Faces from firstFaceOfB on came from B only
+        size_t firstFaceOfB = 0;
+        std::pmr::vector<uint32_t> faces;
+        std::pmr::vector<uint32_t> edges;
+        std::pmr::vector<uint32_t> newFaces;
+        std::pmr::vector<uint32_t> newEdges;
+        std::pmr::vector<uint32_t> neighbors;
+        std::pmr::vector<uint32_t> droppedEdges;
+        // Only filled while recording: the previous position of A, the removed faces
+        // as face, v1, v2, v3 before the collapse and the faces that moved from B to A
+        Vec3 previous;
+        std::pmr::vector<uint32_t> removed;
+        std::pmr::vector<uint32_t> changed;
+
+        explicit Scratch (std::pmr::memory_resource *resource);
+        void Clear ();
+        size_t Bytes () const;
+    } scratch;
+
+    // RunRounds state, claimed holds the round that last claimed a vertex
+    uint32_t round = 0;
+    std::pmr::vector<uint32_t> claimed;
+    std::pmr::vector<uint32_t> selected;
+    std::pmr::vector<uint32_t> rejected;
+    std::vector<Scratch> roundScratch;
+
+    bool Collapse (uint32_t edge);
+    bool Prepare (uint32_t edge, Scratch &s);
+    void Apply (Scratch &s);
+    void Commit (Scratch &s);
+    bool Claim (uint32_t edge);
+    void CheckMemory () const;
+    bool Interrupted (StopCriteria const &stop, std::chrono::steady_clock::time_point start, StopReason &reason) const;
+};
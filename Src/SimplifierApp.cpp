@@ -1,50 +1,146 @@
 #include "SimplifierApp.hpp"
+#include "Batch.hpp"
+#include "Cache.hpp"
+#include "Cluster.hpp"
 #include "Extras.hpp"
+#include "Partition.hpp"
 #include "STL.hpp"
+#include "Simplifier.hpp"
 #include "Simplify.hpp"
+#include "Stream.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
+#include <thread>
 
 namespace fs = std::filesystem;
 
+namespace {
+// Largest relative area or volume difference a result may have against ref=
+constexpr double REFERENCE_TOLERANCE = 1e-3;
+// More threads or jobs than this is a typo rather than a machine
+constexpr size_t MAX_THREADS = 4096;
+
+// The whole text as a non-negative integer, false for anything else, e.g. a sign
+bool ParseCount (std::string const &text, size_t &value) {
+    char const *end = text.data () + text.size ();
+    auto [last, error] = std::from_chars (text.data (), end, value);
+    return error == std::errc () && last == end;
+}
+
+// The whole text as a number
+bool ParseNumber (std::string const &text, double &value) {
+    try {
+        size_t used = 0;
+        value = std::stod (text, &used);
+        return used == text.size ();
+    } catch (std::exception const &) {
+        return false;
+    }
+}
+}
+
 void SimplifierApp::PrintUsage () const {
     l.Log (R"""(Usage:
     example: 
         Simplifier.exe factor=0.1 in=input.stl out=output.stl
         Simplifier.exe in=d:\Downloads\39-stl\stl\Dragon.stl mode=iterative iterations=5
+        Simplifier.exe factor=0.01 in=input.stl pm=input.pm
+        Simplifier.exe factor=0.5 in=input.pm out=output.stl
+        Simplifier.exe factor=0.1 in=scan.stl mode=stream mem=2048
+        Simplifier.exe factor=0.1 in=input.stl out=float.stl ref=double.stl
+        Simplifier.exe factor=0.1 in=input.stl trace=trace.json
+        Simplifier.exe factor=0.1 in=input.stl counters=1
+        Simplifier.exe factor=0.1 in=input.stl maxmem=4096
+        Simplifier.exe factor=0.1 in=d:\models out=d:\simplified jobs=8 maxmem=16384 report=batch.csv
+        Simplifier.exe factor=0.2 in=input.stl cache=d:\cache
     params:
-        - in: input file path
-        - out: output file path             [optional, default=input_simplified<iteration>.stl]
+        - in: input binary or ASCII STL path, a .pm input is refined to factor of its full face count,
+              a directory or a .txt manifest with one STL path per line is simplified as a batch
+        - out: output file path             [optional, default=input_simplified<iteration>.stl] (an existing directory for a batch, default=<input directory>/simplified)
         - factor: 0.01-0.99                 [optional, default=0.5]
-        - mode: simple|iterative            [optional, default=simple]
+        - mode: simple|iterative|partitioned|rounds|stream|cluster [optional, default=simple]
         - iterations: number of iterations  [optional, default=1] (only for iterative mode)
+        - weld: vertex weld tolerance       [optional, default=1e-6]
+        - threads: worker threads           [optional, default=0 (all cores)] (every parallel phase: load, setup, save, modes)
+        - pm: progressive mesh output path  [optional] (not for partitioned, stream and cluster modes)
+        - mem: memory budget in MB          [optional, default=1024] (only for stream mode)
+        - maxmem: working memory limit, MB  [optional, default=0 (none)] (fails early instead of running out of memory, shared by a batch)
+        - jobs: files simplified at once    [optional, default=0 (all cores)] (only for batches)
+        - report: per file CSV output path  [optional] (only for batches)
+        - cache: collapse sequence directory [optional] (only for simple mode, a repeated input at any factor is replayed)
+        - ref: reference result to compare  [optional] (fails on more than 0.1% area or volume difference)
+        - trace: Chrome trace output path   [optional] (open in chrome://tracing or ui.perfetto.dev)
+        - counters: 0|1                     [optional, default=0] (hardware counters per phase, Linux only)
 )""");
 }
 
 int SimplifierApp::ParseParams (size_t argc, char *argv[]) {
     for (size_t i = 1; i < argc; ++i) {
         std::string arg = argv[i];
+        bool valid = true;
         if (arg.find ("in=") == 0) {
             params.inputPath = arg.substr (3);
         } else if (arg.find ("out=") == 0) {
             params.outputPath = arg.substr (4);
+        } else if (arg.find ("pm=") == 0) {
+            params.progressivePath = arg.substr (3);
+        } else if (arg.find ("ref=") == 0) {
+            params.referencePath = arg.substr (4);
+        } else if (arg.find ("trace=") == 0) {
+            params.tracePath = arg.substr (6);
         } else if (arg.find ("factor=") == 0) {
-            params.factor = std::stod (arg.substr (7));
+            valid = ParseNumber (arg.substr (7), params.factor);
         } else if (arg.find ("mode=") == 0) {
             std::string mode = arg.substr (5);
             if (mode == "simple") {
                 params.mode = Params::Mode::Simple;
             } else if (mode == "iterative") {
                 params.mode = Params::Mode::Iterative;
+            } else if (mode == "partitioned") {
+                params.mode = Params::Mode::Partitioned;
+            } else if (mode == "rounds") {
+                params.mode = Params::Mode::Rounds;
+            } else if (mode == "stream") {
+                params.mode = Params::Mode::Stream;
+            } else if (mode == "cluster") {
+                params.mode = Params::Mode::Cluster;
             } else {
                 l.Error ("Unknown mode: ", mode);
                 return 1;
             }
         } else if (arg.find ("iterations=") == 0) {
-            params.iterations = std::stoi (arg.substr (11));
+            valid = ParseCount (arg.substr (11), params.iterations);
+        } else if (arg.find ("weld=") == 0) {
+            valid = ParseNumber (arg.substr (5), params.weldTolerance);
+        } else if (arg.find ("threads=") == 0) {
+            valid = ParseCount (arg.substr (8), params.threads) && params.threads <= MAX_THREADS;
+        } else if (arg.find ("counters=") == 0) {
+            size_t counters = 0;
+            valid = ParseCount (arg.substr (9), counters);
+            params.counters = counters != 0;
+        } else if (arg.find ("jobs=") == 0) {
+            valid = ParseCount (arg.substr (5), params.jobs) && params.jobs <= MAX_THREADS;
+        } else if (arg.find ("cache=") == 0) {
+            params.cachePath = arg.substr (6);
+        } else if (arg.find ("report=") == 0) {
+            params.reportPath = arg.substr (7);
+        } else if (arg.find ("maxmem=") == 0) {
+            valid = ParseCount (arg.substr (7), params.memoryLimit) && params.memoryLimit <= (SIZE_MAX >> 20);
+        } else if (arg.find ("mem=") == 0) {
+            valid = ParseCount (arg.substr (4), params.memoryBudget) && params.memoryBudget <= (SIZE_MAX >> 20);
         } else {
             l.Error ("Unknown argument: ", arg);
             return 1;
         }
+        if (!valid) {
+            l.Error ("Invalid value: ", arg);
+            return 1;
+        }
     }
 
     if (params.inputPath.empty ()) {
@@ -55,36 +151,129 @@ int SimplifierApp::ParseParams (size_t argc, char *argv[]) {
         l.Error ("Invalid number of iterations: ", params.iterations);
         return 1;
     }
-    if (params.factor <= 0 || params.factor >= 1) {
+    if (params.memoryBudget < 1) {
+        l.Error ("Invalid memory budget: ", params.memoryBudget);
+        return 1;
+    }
+    if (params.weldTolerance < 0) {
+        l.Error ("Invalid weld tolerance: ", params.weldTolerance);
+        return 1;
+    }
+    if (params.factor <= 0 || params.factor > 1 || (params.factor == 1 && !RefineInput ())) {
         l.Error ("Invalid factor: ", params.factor);
         return 1;
     }
-    if (!fs::exists (params.inputPath) || !fs::directory_entry{params.inputPath}.is_regular_file ()) {
+    if (!fs::exists (params.inputPath) || (!fs::directory_entry{params.inputPath}.is_regular_file () && !BatchInput ())) {
         l.Error ("Invalid inputPath: ", params.inputPath.string ());
         return 1;
     }
-    if (!params.outputPath.empty () && (!fs::exists (params.outputPath) || !fs::directory_entry{params.outputPath}.is_regular_file ())) {
+    if (!params.outputPath.empty () && (!fs::exists (params.outputPath) || (BatchInput () ? !fs::is_directory (params.outputPath)
+                                                                                          : !fs::directory_entry{params.outputPath}.is_regular_file ()))) {
         l.Error ("Invalid outputPath: ", params.outputPath.string ());
         return 1;
     }
+    if (BatchInput () && (params.mode == Params::Mode::Iterative || params.mode == Params::Mode::Stream || !params.progressivePath.empty ())) {
+        l.Error ("Batches run the simple, partitioned, rounds and cluster modes without progressive output");
+        return 1;
+    }
+    if (!params.cachePath.empty () && (params.mode != Params::Mode::Simple || !params.progressivePath.empty () || RefineInput ())) {
+        l.Error ("The collapse cache works with simple mode only, without progressive output");
+        return 1;
+    }
+    if (!params.progressivePath.empty () && (params.mode == Params::Mode::Partitioned || params.mode == Params::Mode::Stream ||
+                                             params.mode == Params::Mode::Cluster || RefineInput ())) {
+        l.Error ("Progressive mesh output is not supported for this input or mode");
+        return 1;
+    }
 
     return 0;
 }
 
+SimplifyOptions SimplifierApp::Options () const {
+    SimplifyOptions options;
+    options.weldTolerance = params.weldTolerance;
+    options.threads = params.threads;
+    options.memoryLimit = params.memoryLimit << 20;
+    return options;
+}
+
+bool SimplifierApp::RefineInput () const {
+    return params.inputPath.extension () == ".pm";
+}
+
+bool SimplifierApp::BatchInput () const {
+    return fs::is_directory (params.inputPath) || params.inputPath.extension () == ".txt";
+}
+
+Mesh SimplifierApp::RunEngine (Mesh const &mesh, SimplifyOptions const &options, SimplifyStats *stats) const {
+    // Recording needs the collapse sequence, run the Simplifier directly
+    if (!params.progressivePath.empty ()) {
+        Simplifier simplifier (mesh, options);
+        simplifier.Record ();
+        size_t target = static_cast<size_t> (mesh.size () * params.factor);
+        if (params.mode == Params::Mode::Rounds) {
+            simplifier.RunRounds (target);
+        } else {
+            simplifier.Run (target);
+        }
+        simplifier.SaveProgressive (params.progressivePath);
+        if (stats) {
+            *stats = simplifier.Stats ();
+        }
+        return simplifier.Result ();
+    }
+
+    if (!params.cachePath.empty ()) {
+        return SimplifyCached (mesh, params.factor, params.cachePath, options, stats);
+    }
+
+    switch (params.mode) {
+    case Params::Mode::Partitioned:
+        return SimplifyPartitioned (mesh, params.factor, options, stats);
+    case Params::Mode::Rounds:
+        return SimplifyRounds (mesh, params.factor, options, stats);
+    case Params::Mode::Cluster:
+        return SimplifyClustered (mesh, params.factor, options, stats);
+    default:
+        return Simplify (mesh, params.factor, options, stats);
+    }
+}
+
 void SimplifierApp::RunSimpleMode () {
     try {
         l.Log ("Loading ", params.inputPath);
-        Mesh mesh = STL::LoadBinary (params.inputPath);
+        Mesh mesh = [this] () {
+            Trace::Scope trace ("Load");
+            return STL::Load (params.inputPath, params.threads);
+        }();
 
         l.Log ("Input mesh contains ", mesh.size (), " faces");
         l.Log ("Simplifying to ", static_cast<int> (params.factor * 100), "% of original...");
         Mesh simplifiedMesh;
-        long long dur = TimeIt ([&mesh, &simplifiedMesh, factor = params.factor] () {
-            simplifiedMesh = Simplify (mesh, factor);
+        SimplifyStats stats;
+        long long dur = TimeIt ([this, &mesh, &simplifiedMesh, &stats] () {
+            Trace::Scope trace ("Simplify");
+            simplifiedMesh = RunEngine (mesh, Options (), &stats);
         });
 
         l.Log ("Simplification took  ", dur, " ms");
+        if (stats.replayed) {
+            l.Log ("Replayed the collapse sequence from ", params.cachePath.string ());
+        } else if (params.mode != Params::Mode::Cluster) {
+            // Clustering has no arena and no collapse loop
+            l.Log ("Working memory: ", stats.arena.allocations, " allocations served from ", stats.arena.systemAllocations,
+                   " system allocations, peak ", stats.arena.peakBytes / (1024 * 1024), " MB");
+            l.Log ("Collapse loop allocations: ", stats.collapseAllocations, " from the arena");
+            if (stats.memory.Total () > 0) {
+                MemoryUsage const &m = stats.memory;
+                l.Log ("Structures: ", m.Total () >> 20, " MB = vertices ", m.vertices >> 20, ", faces ", m.faces >> 20, ", edges ", m.edges >> 20,
+                       ", adjacency ", m.adjacency >> 20, ", queue ", m.queue >> 20, ", scratch ", m.scratch >> 20, ", records ", m.recorder >> 20);
+            }
+        }
         l.Log ("Output mesh contains ", simplifiedMesh.size (), " faces. Actual factor: ", static_cast<double> (simplifiedMesh.size ()) / mesh.size ());
+        if (!stats.replayed) {
+            l.Log ("Quadric error sum: ", stats.quadricError);
+        }
 
         if (params.outputPath.empty ()) {
             params.outputPath = params.inputPath;
@@ -92,10 +281,20 @@ void SimplifierApp::RunSimpleMode () {
         }
 
         l.Log ("Writing ", params.outputPath.string ());
-        STL::SaveBinary (params.outputPath, simplifiedMesh);
+        {
+            Trace::Scope trace ("Save");
+            STL::SaveBinary (params.outputPath, simplifiedMesh, params.threads);
+        }
+        if (!params.progressivePath.empty ()) {
+            l.Log ("Wrote progressive mesh ", params.progressivePath.string ());
+        }
+        if (!params.referencePath.empty ()) {
+            CheckReference (simplifiedMesh);
+        }
 
     } catch (const std::exception &e) {
         l.Error (e.what ());
+        failed = true;
         return;
     }
 }
@@ -103,46 +302,221 @@ void SimplifierApp::RunSimpleMode () {
 void SimplifierApp::RunIterativeMode () {
     try {
         l.Log ("Loading ", params.inputPath);
-        Mesh mesh = STL::LoadBinary (params.inputPath);
+        Mesh mesh = STL::Load (params.inputPath, params.threads);
 
         l.Log ("Input mesh contains ", mesh.size (), " faces");
         l.Log ("Simplifying... ");
         std::vector<std::pair<size_t, long long>> iterationStats;
 
+        // One collapse sequence for all levels, every iteration continues where the previous one stopped
+        std::unique_ptr<Simplifier> simplifier;
+        long long setup = TimeIt ([this, &mesh, &simplifier] () {
+            simplifier = std::make_unique<Simplifier> (mesh, Options ());
+        });
+        if (!params.progressivePath.empty ()) {
+            simplifier->Record ();
+        }
+
         Mesh simplifiedMesh;
-        Mesh previousMesh = mesh;
         for (size_t iteration = 0; iteration < params.iterations; iteration++) {
-            long long dur = TimeIt ([&previousMesh, &simplifiedMesh, factor = params.factor] () {
-                simplifiedMesh = Simplify (previousMesh, factor);
+            size_t target = static_cast<size_t> (simplifier->FaceCount () * params.factor);
+            long long dur = TimeIt ([&simplifier, &simplifiedMesh, target] () {
+                Trace::Scope trace ("Iteration");
+                simplifier->Run (target);
+                simplifiedMesh = simplifier->Result ();
             });
-            iterationStats.push_back ({simplifiedMesh.size (), dur});
+            iterationStats.push_back ({simplifiedMesh.size (), iteration == 0 ? setup + dur : dur});
 
             if (iterationStats.size () > 2 && iterationStats[iteration].first == iterationStats[iteration - 1].first) {
                 break;
             }
             auto outName = fs::path (params.inputPath).replace_filename (params.inputPath.stem ().string () + "_simplified" + std::to_string (iteration + 1) + ".stl");
-            STL::SaveBinary (outName, simplifiedMesh);
-            previousMesh = simplifiedMesh;
+            STL::SaveBinary (outName, simplifiedMesh, params.threads);
         }
         for (size_t i = 0; i < iterationStats.size (); i++)
             l.Log ("Iteration ", i + 1, " | ", iterationStats[i].first, " faces | duration: ", iterationStats[i].second, " ms");
         if (iterationStats.size () > 2 && iterationStats[iterationStats.size () - 1].first == iterationStats[iterationStats.size () - 2].first) {
             l.Log ("No further simplification possible");
         }
+        if (!params.progressivePath.empty ()) {
+            simplifier->SaveProgressive (params.progressivePath);
+            l.Log ("Wrote progressive mesh ", params.progressivePath.string ());
+        }
 
     } catch (const std::exception &e) {
         l.Error (e.what ());
+        failed = true;
+    }
+}
+
+void SimplifierApp::RunRefineMode () {
+    try {
+        l.Log ("Loading ", params.inputPath);
+        Progressive::Reader reader (params.inputPath);
+        l.Log ("Progressive mesh contains ", reader.FaceCount (), " of ", reader.FullFaceCount (), " faces");
+
+        Mesh refinedMesh;
+        long long dur = TimeIt ([this, &reader, &refinedMesh] () {
+            reader.RefineTo (static_cast<size_t> (reader.FullFaceCount () * params.factor));
+            refinedMesh = reader.Extract ();
+        });
+        l.Log ("Refining to ", refinedMesh.size (), " faces took ", dur, " ms");
+
+        if (params.outputPath.empty ()) {
+            params.outputPath = params.inputPath;
+            params.outputPath.replace_filename (params.inputPath.stem ().string () + "_refined.stl");
+        }
+        l.Log ("Writing ", params.outputPath.string ());
+        STL::SaveBinary (params.outputPath, refinedMesh, params.threads);
+
+    } catch (const std::exception &e) {
+        l.Error (e.what ());
+        failed = true;
+    }
+}
+
+// Regression check of a result against one of another build or engine, e.g. float against double
+void SimplifierApp::CheckReference (Mesh const &mesh) {
+    MeshQuality result = MeasureQuality (mesh);
+    MeshQuality reference = MeasureQuality (STL::Load (params.referencePath, params.threads));
+    auto deviation = [] (double value, double expected) {
+        return std::abs (value - expected) / std::max (std::abs (expected), EPSILON);
+    };
+    double area = deviation (result.area, reference.area);
+    double volume = deviation (result.volume, reference.volume);
+
+    l.Log ("Reference ", params.referencePath.string (), ": ", reference.faces, " faces, area ", reference.area, ", volume ", reference.volume);
+    l.Log ("Result: ", result.faces, " faces, area ", result.area, " (", area * 100, "%), volume ", result.volume, " (", volume * 100, "%)");
+    if (area > REFERENCE_TOLERANCE || volume > REFERENCE_TOLERANCE) {
+        l.Error ("Result deviates from the reference by more than ", REFERENCE_TOLERANCE * 100, "%");
+        failed = true;
+    }
+}
+
+void SimplifierApp::RunStreamMode () {
+    try {
+        if (params.outputPath.empty ()) {
+            params.outputPath = params.inputPath;
+            params.outputPath.replace_filename (params.inputPath.stem ().string () + "_simplified.stl");
+        }
+
+        l.Log ("Streaming ", params.inputPath, " to ", params.outputPath.string (), " within ", params.memoryBudget, " MB");
+        size_t faces = 0;
+        SimplifyStats stats;
+        long long dur = TimeIt ([this, &faces, &stats] () {
+            faces = SimplifyStreaming (params.inputPath, params.outputPath, params.factor, params.memoryBudget << 20, Options (), &stats);
+        });
+
+        l.Log ("Simplification took  ", dur, " ms");
+        l.Log ("Peak working memory of a bucket: ", stats.arena.peakBytes / (1024 * 1024), " MB");
+        l.Log ("Output mesh contains ", faces, " faces");
+        l.Log ("Quadric error sum: ", stats.quadricError);
+
+    } catch (const std::exception &e) {
+        l.Error (e.what ());
+        failed = true;
     }
 }
 
 void SimplifierApp::Run () {
+    if (params.counters && !PerfCounters::Start ()) {
+        l.Log ("Performance counters unavailable: ", PerfCounters::Unavailable ());
+    }
+    if (!params.tracePath.empty ()) {
+        Trace::Start ();
+    }
+    RunMode ();
+    PerfCounters::Report (l);
+    if (!params.tracePath.empty ()) {
+        try {
+            Trace::Write (params.tracePath);
+            l.Log ("Wrote trace ", params.tracePath.string ());
+        } catch (const std::exception &e) {
+            l.Error (e.what ());
+            failed = true;
+        }
+    }
+    if (size_t peak = PeakMemoryBytes ()) {
+        l.Log ("Peak memory: ", peak >> 20, " MB");
+    }
+}
+
+void SimplifierApp::RunBatchMode () {
+    try {
+        // Outputs go to their own directory, a later run over the input directory does not pick them up
+        fs::path inputDirectory = fs::is_directory (params.inputPath) ? params.inputPath : params.inputPath.parent_path ();
+        fs::path outputDirectory = params.outputPath.empty () ? inputDirectory / "simplified" : params.outputPath;
+        if (fs::exists (outputDirectory) && fs::equivalent (outputDirectory, inputDirectory)) {
+            throw std::runtime_error ("The batch output directory must differ from the input directory " + inputDirectory.string ());
+        }
+        fs::create_directories (outputDirectory);
+
+        std::vector<BatchFile> files;
+        for (fs::path const &input : BatchInputs (params.inputPath)) {
+            BatchFile file;
+            file.input = input;
+            file.output = outputDirectory / (input.stem ().string () + "_simplified.stl");
+            files.push_back (file);
+        }
+        size_t jobs = params.jobs ? params.jobs : std::max (1u, std::thread::hardware_concurrency ());
+        l.Log ("Simplifying ", files.size (), " files to ", static_cast<int> (params.factor * 100), "%, ", jobs, " at once");
+
+        // The jobs are the parallelism, each simplification runs on one thread
+        SimplifyOptions options = Options ();
+        options.threads = 1;
+        long long dur = TimeIt ([this, &files, jobs, &options] () {
+            SimplifyBatch (files, jobs, params.memoryLimit << 20, [this, &options] (Mesh const &mesh) {
+                return RunEngine (mesh, options, nullptr);
+            });
+        });
+
+        size_t failures = 0, inputFaces = 0, outputFaces = 0;
+        for (BatchFile const &file : files) {
+            if (file.error.empty ()) {
+                l.Log (file.input.filename ().string (), " | ", file.inputFaces, " -> ", file.outputFaces, " faces | load ", file.loadMs,
+                       " ms, simplify ", file.simplifyMs, " ms, save ", file.saveMs, " ms");
+                inputFaces += file.inputFaces;
+                outputFaces += file.outputFaces;
+            } else {
+                l.Error (file.input.filename ().string (), " | ", file.error);
+                failures++;
+            }
+        }
+        l.Log ("Batch took ", dur, " ms: ", files.size () - failures, " files, ", inputFaces, " -> ", outputFaces, " faces, ", failures, " failed");
+        if (!params.reportPath.empty ()) {
+            SaveBatchReport (params.reportPath, files);
+            l.Log ("Wrote report ", params.reportPath.string ());
+        }
+        failed = failures > 0;
+
+    } catch (const std::exception &e) {
+        l.Error (e.what ());
+        failed = true;
+    }
+}
+
+void SimplifierApp::RunMode () {
+    if (RefineInput ()) {
+        RunRefineMode ();
+        return;
+    }
+    if (BatchInput ()) {
+        RunBatchMode ();
+        return;
+    }
     switch (params.mode) {
     case Params::Mode::Simple:
+    case Params::Mode::Partitioned:
+    case Params::Mode::Rounds:
+    case Params::Mode::Cluster:
         RunSimpleMode ();
         break;
     case Params::Mode::Iterative:
         RunIterativeMode ();
         break;
+    case Params::Mode::Stream:
+        RunStreamMode ();
+        break;
     default:
         l.Error ("Unknown mode: ", static_cast<int> (params.mode));
         break;
@@ -1,4 +1,6 @@
 #pragma once
+#include "Geometry.hpp"
+#include "Simplify.hpp"
 #include "Logger.hpp"
 #include "SimplifierApp.hpp"
 #include <filesystem>
@@ -6,18 +8,43 @@
 class SimplifierApp {
     struct Params {
         enum class Mode { Simple,
-                          Iterative };
+                          Iterative,
+                          Partitioned,
+                          Rounds,
+                          Stream,
+                          Cluster };
         double factor = 0.5;
         std::filesystem::path inputPath;
         std::filesystem::path outputPath;
+        std::filesystem::path progressivePath;
+        std::filesystem::path referencePath;
+        std::filesystem::path tracePath;
+        std::filesystem::path reportPath;
+        std::filesystem::path cachePath;
         Mode mode = Mode::Simple;
         size_t iterations = 1;
+        double weldTolerance = EPSILON;
+        size_t threads = 0;
+        size_t jobs = 0;            // files at once in batch mode, 0 = all hardware threads
+        size_t memoryBudget = 1024; // MB, stream mode
+        size_t memoryLimit = 0;     // MB, 0 = unlimited
+        bool counters = false;
     };
     Params params;
     void PrintUsage () const;
     int ParseParams (size_t argc, char *argv[]);
+    SimplifyOptions Options () const;
+    Mesh RunEngine (Mesh const &mesh, SimplifyOptions const &options, SimplifyStats *stats) const;
     void RunSimpleMode ();
     void RunIterativeMode ();
+    void RunRefineMode ();
+    void RunStreamMode ();
+    void RunBatchMode ();
+    void RunMode ();
+    void CheckReference (Mesh const &mesh);
+    bool failed = false;
+    bool RefineInput () const;
+    bool BatchInput () const;
     Logger l;
 
   public:
@@ -25,4 +52,6 @@ class SimplifierApp {
     ~SimplifierApp () = default;
     bool Init (int argc, char *argv[]);
     void Run ();
+    // A mode hit an error or the result deviates from the reference
+    bool Failed () const { return failed; }
 };
\ No newline at end of file
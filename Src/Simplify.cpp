@@ -1,221 +1,183 @@
 #include "Simplify.hpp"
-#include <memory>
-#include <queue>
+#include "Simplifier.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <stdexcept>
 #include <vector>
 
-std::map<Vec3, Vertex> CreateVertices (Mesh const &input) {
-    std::map<Vec3, Vertex> vectorVertex;
-    for (const Triangle &t : input) {
-        vectorVertex[t.v1] = Vertex (t.v1);
-        vectorVertex[t.v2] = Vertex (t.v2);
-        vectorVertex[t.v3] = Vertex (t.v3);
-    }
+void Accumulate (SimplifyStats &total, SimplifyStats const &stats) {
+    total.arena.allocations += stats.arena.allocations;
+    total.arena.systemAllocations += stats.arena.systemAllocations;
+    total.arena.peakBytes += stats.arena.peakBytes;
+    total.collapseAllocations += stats.collapseAllocations;
+    total.quadricError += stats.quadricError;
+    total.memory.vertices += stats.memory.vertices;
+    total.memory.faces += stats.memory.faces;
+    total.memory.edges += stats.memory.edges;
+    total.memory.adjacency += stats.memory.adjacency;
+    total.memory.queue += stats.memory.queue;
+    total.memory.scratch += stats.memory.scratch;
+    total.memory.recorder += stats.memory.recorder;
+}
 
-    // Accumulate quadric matrices for each vertex based on its faces
-    for (const Triangle &t : input) {
-        Matrix q = t.Quadric ();
-        Vertex &v1 = vectorVertex[t.v1];
-        Vertex &v2 = vectorVertex[t.v2];
-        Vertex &v3 = vectorVertex[t.v3];
-        v1.q = v1.q + q;
-        v2.q = v2.q + q;
-        v3.q = v3.q + q;
+void CheckMemoryLimit (size_t bytes, size_t memoryLimit, std::string const &what) {
+    if (memoryLimit == 0 || bytes <= memoryLimit) {
+        return;
     }
-
-    return vectorVertex;
+    throw std::runtime_error (what + " needs " + std::to_string (bytes >> 20) + " MB, over the memory limit of " +
+                              std::to_string (memoryLimit >> 20) + " MB");
 }
 
-std::map<Vertex const *, std::vector<Face const *>> CreateFacesAndMapVertices (
-    Mesh const &input,
-    std::map<Vec3, Vertex> const &vectorVertex,
-    std::vector<std::unique_ptr<Face>> &facesToDelete) {
-
-    std::map<Vertex const *, std::vector<Face const *>> vertexFaces;
-
+// Weld positions closer than weldTolerance, indices receives 3 vertex indices per triangle.
+// Triangles collapsed by the welding are dropped. A vertex is locked if any of its
+// triangle corners is set in lockedCorners (3 flags per triangle, or empty).
+void CreateVertices (Mesh const &input, double weldTolerance, std::vector<bool> const &lockedCorners,
+                     std::pmr::vector<uint32_t> &indices, IndexedMesh &mesh) {
+    Trace::Scope trace ("CreateVertices");
+    VertexWelder welder (weldTolerance, input.size ());
+    indices.clear ();
+    indices.reserve (input.size () * 3);
     for (const Triangle &t : input) {
-        Vertex const &v1 = vectorVertex.at (t.v1);
-        Vertex const &v2 = vectorVertex.at (t.v2);
-        Vertex const &v3 = vectorVertex.at (t.v3);
-        facesToDelete.push_back (std::make_unique<Face> (&v1, &v2, &v3));
-        Face *f = facesToDelete.back ().get ();
-
-        vertexFaces[&v1].push_back (f);
-        vertexFaces[&v2].push_back (f);
-        vertexFaces[&v3].push_back (f);
+        uint32_t i1 = welder.Weld (t.v1);
+        uint32_t i2 = welder.Weld (t.v2);
+        uint32_t i3 = welder.Weld (t.v3);
+        if (i1 != i2 && i1 != i3 && i2 != i3) {
+            indices.insert (indices.end (), {i1, i2, i3});
+        }
     }
 
-    return vertexFaces;
-}
-
-Mesh Simplify (Mesh const &input, double factor) {
-    std::vector<std::unique_ptr<Vertex>> vertexesToDelete;
-    std::vector<std::unique_ptr<Face>> facesToDelete;
-    std::vector<std::unique_ptr<Edge>> newEdges;
-
-    size_t numFaces = input.size ();
-
-    auto const vectorVertex = CreateVertices (input);
-    auto vertexFaces = CreateFacesAndMapVertices (input, vectorVertex, facesToDelete);
+    mesh.vertices.assign (welder.Positions ().begin (), welder.Positions ().end ());
 
-    // Find distinct pairs (Edges)
-    std::map<PairKey, Edge> edges;
-    for (const Triangle &t : input) {
-        Vertex const *v1 = &vectorVertex.at (t.v1);
-        Vertex const *v2 = &vectorVertex.at (t.v2);
-        Vertex const *v3 = &vectorVertex.at (t.v3);
-
-        edges[MakePairKey (v1, v2)] = Edge (v1, v2);
-        edges[MakePairKey (v2, v3)] = Edge (v2, v3);
-        edges[MakePairKey (v3, v1)] = Edge (v3, v1);
+    if (!lockedCorners.empty ()) {
+        mesh.locked.assign (mesh.vertices.size (), 0);
+        for (size_t i = 0; i < input.size (); ++i) {
+            for (size_t k = 0; k < 3; ++k) {
+                if (lockedCorners[3 * i + k]) {
+                    mesh.locked[welder.Weld (k == 0 ? input[i].v1 : k == 1 ? input[i].v2 : input[i].v3)] = 1;
+                }
+            }
+        }
     }
+}
 
-    // assume edges size doesn't change
+// Accumulate the quadric of each vertex based on its faces.
+// Every vertex sums its faces in face order whatever the thread count, so the
+// parallel result is bit-identical to the serial one.
+void CreateQuadrics (IndexedMesh &mesh, ThreadPool &pool) {
+    Trace::Scope trace ("CreateQuadrics");
+    pool.ParallelFor (mesh.vertices.size (), [&mesh] (size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            Quadric q;
+            for (uint32_t f : mesh.vertexFaces.Get (static_cast<uint32_t> (v))) {
+                q += mesh.faces[f].ToTriangle (mesh.vertices).Quadric ();
+            }
+            mesh.vertices[v].q = q;
+        }
+    });
+}
 
-    // Enqueue edges and map vertex => edges
-    std::priority_queue<Edge *, std::vector<Edge *>, EdgeComparator> queue;
-    std::map<Vertex const *, std::vector<Edge *>> vertexEdges;
-    for (auto &p : edges) {
-        queue.push (&p.second);
-        vertexEdges[p.second.A].push_back (&p.second);
-        vertexEdges[p.second.B].push_back (&p.second);
+void CreateFacesAndMapVertices (std::pmr::vector<uint32_t> const &indices, IndexedMesh &mesh) {
+    Trace::Scope trace ("CreateFacesAndMapVertices");
+    mesh.faces.clear ();
+    mesh.faces.reserve (indices.size () / 3);
+    for (size_t i = 0; i < indices.size (); i += 3) {
+        mesh.faces.emplace_back (indices[i], indices[i + 1], indices[i + 2]);
     }
 
-    // Simplify
-    size_t target = static_cast<int> (numFaces * factor);
-    while (numFaces > target && queue.size () > 0) {
-        Edge *p = queue.top ();
-        queue.pop ();
-
-        if (p->Removed) {
-            continue;
-        }
-        p->Removed = true;
+    std::pmr::vector<Face> const &faces = mesh.faces;
+    mesh.vertexFaces.Build (mesh.vertices.size (), faces.size (), 3, [&faces] (size_t f, size_t k) {
+        return k == 0 ? faces[f].v1 : k == 1 ? faces[f].v2 : faces[f].v3;
+    });
+}
 
-        // Get related faces
-        std::set<Face const *> distinctFaces;
-        for (Face const *f : vertexFaces[p->A]) {
-            if (!f->Removed) {
-                distinctFaces.insert (f);
+// Find distinct pairs (Edges) of the faces. An edge belongs to its lower vertex,
+// listing the higher neighbors of every vertex in order yields the edges sorted by (A, B).
+void CreateEdges (IndexedMesh &mesh, ThreadPool &pool) {
+    Trace::Scope trace ("CreateEdges");
+    size_t vertexCount = mesh.vertices.size ();
+    auto higherNeighbors = [&mesh] (uint32_t v, std::vector<uint32_t> &neighbors) {
+        neighbors.clear ();
+        for (uint32_t f : mesh.vertexFaces.Get (v)) {
+            Face const &face = mesh.faces[f];
+            for (uint32_t n : {face.v1, face.v2, face.v3}) {
+                if (n > v) {
+                    neighbors.push_back (n);
+                }
             }
         }
-        for (Face const *f : vertexFaces[p->B]) {
-            if (!f->Removed) {
-                distinctFaces.insert (f);
-            }
+        std::sort (neighbors.begin (), neighbors.end ());
+        neighbors.erase (std::unique (neighbors.begin (), neighbors.end ()), neighbors.end ());
+    };
+
+    std::pmr::vector<uint32_t> firstEdge (vertexCount + 1, 0, mesh.Resource ());
+    pool.ParallelFor (vertexCount, [&] (size_t begin, size_t end) {
+        std::vector<uint32_t> neighbors;
+        for (size_t v = begin; v < end; ++v) {
+            higherNeighbors (static_cast<uint32_t> (v), neighbors);
+            firstEdge[v + 1] = static_cast<uint32_t> (neighbors.size ());
         }
+    });
+    for (size_t v = 0; v < vertexCount; ++v) {
+        firstEdge[v + 1] += firstEdge[v];
+    }
 
-        // Get related edges
-        std::unordered_set<Edge *> distinctEdges;
-        for (const auto &q : vertexEdges[p->A]) {
-            if (!q->Removed) {
-                distinctEdges.insert (q);
-            }
-        }
-        for (const auto &q : vertexEdges[p->B]) {
-            if (!q->Removed) {
-                distinctEdges.insert (q);
+    mesh.edges.assign (firstEdge.back (), Edge ());
+    pool.ParallelFor (vertexCount, [&] (size_t begin, size_t end) {
+        std::vector<uint32_t> neighbors;
+        for (size_t v = begin; v < end; ++v) {
+            higherNeighbors (static_cast<uint32_t> (v), neighbors);
+            for (size_t i = 0; i < neighbors.size (); ++i) {
+                mesh.edges[firstEdge[v] + i] = Edge (static_cast<uint32_t> (v), neighbors[i]);
             }
         }
+    });
 
-        // Create the new vertex
-        vertexesToDelete.push_back (p->ComputeNewVertex ());
-        Vertex *v = vertexesToDelete.back ().get ();
-
-        // Update faces
-        std::vector<Face *> newFaces;
-        bool valid = true;
-        for (const auto &f : distinctFaces) {
-            Vertex const *v1 = f->v1;
-            Vertex const *v2 = f->v2;
-            Vertex const *v3 = f->v3;
-            if (v1 == p->A || v1 == p->B) {
-                v1 = v;
-            }
-            if (v2 == p->A || v2 == p->B) {
-                v2 = v;
-            }
-            if (v3 == p->A || v3 == p->B) {
-                v3 = v;
-            }
-            facesToDelete.push_back (std::make_unique<Face> (v1, v2, v3));
-            Face *face = facesToDelete.back ().get ();
-            if (face->Degenerate ()) {
-                continue;
-            }
-            if (face->Normal ().Dot (f->Normal ()) < EPSILON) {
-                valid = false;
-                break;
-            }
-            newFaces.push_back (face);
-        }
-        if (!valid) {
-            continue;
-        }
-        vertexFaces.erase (p->A);
-        vertexFaces.erase (p->B);
-        for (Face const *f : distinctFaces) {
-            f->Removed = true;
-            numFaces--;
-        }
-        for (Face const *f : newFaces) {
-            numFaces++;
-            vertexFaces[f->v1].push_back (f);
-            vertexFaces[f->v2].push_back (f);
-            vertexFaces[f->v3].push_back (f);
-        }
+    std::pmr::vector<Edge> const &edges = mesh.edges;
+    mesh.vertexEdges.Build (vertexCount, edges.size (), 2, [&edges] (size_t e, size_t k) {
+        return k == 0 ? edges[e].A : edges[e].B;
+    });
+}
 
-        // Update edges and prune current pair
-        vertexEdges.erase (p->A);
-        vertexEdges.erase (p->B);
-        std::set<Vec3> seen;
-        for (Edge *q : distinctEdges) {
-            q->Removed = true;
-            queue.push (q);
-            Vertex const *a = q->A;
-            Vertex const *b = q->B;
-            if (a == p->A || a == p->B) {
-                a = v;
-            }
-            if (b == p->A || b == p->B) {
-                b = v;
-            }
-            if (b == v) {
-                std::swap (a, b);
-            }
-            if (seen.count (b->v)) {
-                continue;
-            }
-            seen.insert (b->v);
+IndexedMesh CreateIndexedMesh (Mesh const &input, SimplifyOptions const &options, ThreadPool &pool,
+                               std::vector<bool> const &lockedCorners) {
+    // Fail before the allocations rather than during them
+    CheckMemoryLimit (input.size () * WORKING_BYTES_PER_FACE, options.memoryLimit, "Simplifying " + std::to_string (input.size ()) + " faces");
+    IndexedMesh mesh;
+    std::pmr::vector<uint32_t> indices (mesh.Resource ());
+    CreateVertices (input, options.weldTolerance, lockedCorners, indices, mesh);
+    CreateFacesAndMapVertices (indices, mesh);
+    CreateQuadrics (mesh, pool);
+    CreateEdges (mesh, pool);
+    return mesh;
+}
 
-            newEdges.push_back (std::make_unique<Edge> (a, b));
-            Edge *q2 = newEdges.back ().get ();
-            queue.push (q2);
-            vertexEdges[a].push_back (q2);
-            vertexEdges[b].push_back (q2);
-        }
+Mesh Simplify (Mesh const &input, double factor, SimplifyOptions const &options, SimplifyStats *stats) {
+    Simplifier simplifier (input, options);
+    simplifier.Run (static_cast<size_t> (input.size () * factor));
+    if (stats) {
+        *stats = simplifier.Stats ();
     }
-
-    return ConstructMesh (vertexFaces);
+    return simplifier.Result ();
 }
 
-Mesh ConstructMesh (std::map<Vertex const *, std::vector<Face const *>> const &vertexFaces) {
-    // Find distinct faces
-    std::unordered_set<Face const *> distinctFaces;
-    distinctFaces.reserve (vertexFaces.size ());
-    for (auto &faces : vertexFaces) {
-        for (Face const *f : faces.second) {
-            if (!f->Removed) {
-                distinctFaces.emplace (f);
-            }
-        }
+Mesh SimplifyRounds (Mesh const &input, double factor, SimplifyOptions const &options, SimplifyStats *stats) {
+    Simplifier simplifier (input, options);
+    simplifier.RunRounds (static_cast<size_t> (input.size () * factor));
+    if (stats) {
+        *stats = simplifier.Stats ();
     }
+    return simplifier.Result ();
+}
 
-    // Construct resulting mesh
+Mesh ConstructMesh (IndexedMesh const &mesh) {
+    Trace::Scope trace ("ConstructMesh");
     std::vector<Triangle> simplifiedMesh;
-    simplifiedMesh.reserve (distinctFaces.size ());
+    simplifiedMesh.reserve (mesh.faces.size ());
 
-    for (Face const *f : distinctFaces) {
-        simplifiedMesh.emplace_back (f->v1->v, f->v2->v, f->v3->v);
+    for (Face const &f : mesh.faces) {
+        if (!f.Removed) {
+            simplifiedMesh.push_back (f.ToTriangle (mesh.vertices));
+        }
     }
     return simplifiedMesh;
 }
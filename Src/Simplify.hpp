@@ -2,10 +2,54 @@
 
 #include "Edge.hpp"
 #include "Geometry.hpp"
-#include <map>
-#include <set>
-#include <unordered_set>
+#include "IndexedMesh.hpp"
+#include "ThreadPool.hpp"
+#include "Weld.hpp"
+#include <string>
 
-std::map<Vec3, Vertex> CreateVertices (Mesh const &input);
-Mesh Simplify (Mesh const &input, double factor);
-Mesh ConstructMesh (std::map<Vertex const *, std::vector<Face const *>> const &vertexFaces);
\ No newline at end of file
+// Peak working memory of a Simplifier per input face, input mesh and result included
+constexpr size_t WORKING_BYTES_PER_FACE = 320;
+
+struct SimplifyOptions {
+    double weldTolerance = EPSILON;
+    size_t threads = 1;     // setup threads, 0 = all hardware threads
+    size_t memoryLimit = 0; // bytes of working memory, 0 = unlimited
+};
+
+// Bytes held by the structures of a Simplifier. They grow but never shrink, so this is also their peak.
+struct MemoryUsage {
+    size_t vertices = 0;
+    size_t faces = 0;
+    size_t edges = 0;
+    size_t adjacency = 0; // vertex => faces and vertex => edges
+    size_t queue = 0;
+    size_t scratch = 0;  // collapse buffers, round state and vertex locks
+    size_t recorder = 0; // progressive mesh records
+
+    size_t Total () const { return vertices + faces + edges + adjacency + queue + scratch + recorder; }
+};
+
+struct SimplifyStats {
+    ArenaStats arena;
+    size_t collapseAllocations = 0;     // arena requests made by the collapse loop
+    double quadricError = 0;            // sum of the vertex quadric errors of the result
+    MemoryUsage memory;
+    bool replayed = false; // the result came from the collapse cache, nothing else was counted
+};
+
+// Add the counters of stats to total, for engines running several Simplifiers
+void Accumulate (SimplifyStats &total, SimplifyStats const &stats);
+// Throws when bytes exceeds memoryLimit, unless it is 0, before the kernel kills the process for it
+void CheckMemoryLimit (size_t bytes, size_t memoryLimit, std::string const &what);
+
+void CreateVertices (Mesh const &input, double weldTolerance, std::vector<bool> const &lockedCorners,
+                     std::pmr::vector<uint32_t> &indices, IndexedMesh &mesh);
+void CreateFacesAndMapVertices (std::pmr::vector<uint32_t> const &indices, IndexedMesh &mesh);
+void CreateQuadrics (IndexedMesh &mesh, ThreadPool &pool);
+void CreateEdges (IndexedMesh &mesh, ThreadPool &pool);
+IndexedMesh CreateIndexedMesh (Mesh const &input, SimplifyOptions const &options, ThreadPool &pool,
+                               std::vector<bool> const &lockedCorners = {});
+Mesh Simplify (Mesh const &input, double factor, SimplifyOptions const &options = {}, SimplifyStats *stats = nullptr);
+// Collapses batches of independent edges concurrently, see Simplifier::RunRounds
+Mesh SimplifyRounds (Mesh const &input, double factor, SimplifyOptions const &options = {}, SimplifyStats *stats = nullptr);
+Mesh ConstructMesh (IndexedMesh const &mesh);
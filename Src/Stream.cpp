@@ -0,0 +1,381 @@
+#include "Stream.hpp"
+#include "MappedFile.hpp"
+#include "STL.hpp"
+#include "Simplifier.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+// Cells per axis of the grid the buckets are made of
+constexpr size_t GRID = 64;
+// Subcells per axis of a cell with more faces than a bucket holds
+constexpr size_t SUB = 4;
+// Times a subcell may be split again, each costs a pass over the input
+constexpr size_t MAX_REFINE = 8;
+// Bucket files open at once, more buckets take more distribution passes
+constexpr size_t MAX_OPEN_BUCKETS = 256;
+// Triangles per read of the streaming passes
+constexpr size_t READ_BLOCK = 1 << 16;
+
+// Uniform grid over the input bounds, a cell belongs to one bucket. A refined cell is
+// split into SUB^3 subcells, numbered after the cells there were before, which may be
+// refined in turn.
+class Grid {
+  public:
+    Grid (Vec3 const &lo, Vec3 const &hi) : lo (lo), firstSub (GRID * GRID * GRID, NONE) {
+        Vec3 extent = hi - lo;
+        double size = std::max<double> ({extent.x, extent.y, extent.z, EPSILON});
+        scale = GRID / size;
+    }
+
+    // Cell or subcell of a position
+    size_t Id (Vec3 const &v) const {
+        Vec3 p = v - lo;
+        double s = scale;
+        size_t side = GRID;
+        auto index = [&s, &side] (double c) {
+            return std::min (static_cast<size_t> (std::max (0.0, c * s)), side - 1);
+        };
+        size_t id = (index (p.x) * GRID + index (p.y)) * GRID + index (p.z);
+        while (firstSub[id] != NONE) {
+            s *= SUB;
+            side *= SUB;
+            id = firstSub[id] + (index (p.x) % SUB * SUB + index (p.y) % SUB) * SUB + index (p.z) % SUB;
+        }
+        return id;
+    }
+
+    // Split the cells holding more than capacity faces, false when there are none
+    bool Refine (std::vector<uint32_t> const &faces, size_t capacity) {
+        size_t count = firstSub.size ();
+        for (size_t id = 0; id < count; ++id) {
+            if (firstSub[id] == NONE && faces[id] > capacity) {
+                firstSub[id] = firstSub.size ();
+                firstSub.resize (firstSub.size () + SUB * SUB * SUB, NONE);
+            }
+        }
+        return firstSub.size () > count;
+    }
+
+    size_t IdCount () const { return firstSub.size (); }
+    bool Refined (size_t id) const { return firstSub[id] != NONE; }
+    size_t FirstSub (size_t id) const { return firstSub[id]; }
+
+  private:
+    static constexpr size_t NONE = SIZE_MAX;
+    Vec3 lo;
+    double scale;
+    std::vector<size_t> firstSub;
+};
+
+// Cell index of a side^3 grid to z-order, neighboring cells end up in the same bucket
+size_t Morton (size_t cell, size_t side) {
+    size_t code = 0;
+    size_t coords[3] = {cell / (side * side), cell / side % side, cell % side};
+    for (size_t bit = 0; (size_t{1} << bit) < side; ++bit) {
+        for (size_t axis = 0; axis < 3; ++axis) {
+            code |= ((coords[axis] >> bit) & 1) << (3 * bit + 2 - axis);
+        }
+    }
+    return code;
+}
+
+// Cells of a side^3 grid in z-order
+std::vector<size_t> ZOrder (size_t side) {
+    std::vector<size_t> order (side * side * side);
+    for (size_t cell = 0; cell < order.size (); ++cell) {
+        order[Morton (cell, side)] = cell;
+    }
+    return order;
+}
+
+void WriteTriangle (std::ofstream &file, Triangle const &t) {
+    float d[9] = {
+        static_cast<float> (t.v1.x), static_cast<float> (t.v1.y), static_cast<float> (t.v1.z),
+        static_cast<float> (t.v2.x), static_cast<float> (t.v2.y), static_cast<float> (t.v2.z),
+        static_cast<float> (t.v3.x), static_cast<float> (t.v3.y), static_cast<float> (t.v3.z)};
+    file.write (reinterpret_cast<const char *> (d), sizeof (d));
+}
+
+Mesh ReadTriangles (fs::path const &path, size_t count) {
+    std::ifstream file (path, std::ios::binary);
+    std::vector<float> d (9 * count);
+    file.read (reinterpret_cast<char *> (d.data ()), d.size () * sizeof (float));
+    if (!file) {
+        throw std::runtime_error ("Error reading bucket " + path.string ());
+    }
+    Mesh mesh;
+    mesh.reserve (count);
+    for (size_t i = 0; i < d.size (); i += 9) {
+        mesh.emplace_back (Vec3 (d[i], d[i + 1], d[i + 2]), Vec3 (d[i + 3], d[i + 4], d[i + 5]), Vec3 (d[i + 6], d[i + 7], d[i + 8]));
+    }
+    return mesh;
+}
+
+// Bucket files live next to the output and go away with this
+struct TempDirectory {
+    fs::path path;
+
+    explicit TempDirectory (fs::path const &p) : path (p) {
+        fs::create_directories (path);
+    }
+    ~TempDirectory () {
+        std::error_code error;
+        fs::remove_all (path, error);
+    }
+};
+}
+
+size_t SimplifyStreaming (fs::path const &input, fs::path const &output, double factor, size_t memoryBudget,
+                          SimplifyOptions const &options, SimplifyStats *stats) {
+    Trace::Scope trace ("SimplifyStreaming");
+    {
+        MappedFile file (input);
+        if (STL::IsASCII (file.Data (), file.Size ())) {
+            throw std::runtime_error ("Streaming needs a binary STL, " + input.string () + " is ASCII");
+        }
+    }
+    STL::BinaryReader reader (input);
+    Mesh block;
+
+    // Pass 1: bounds
+    Vec3 lo (1e300, 1e300, 1e300), hi (-1e300, -1e300, -1e300);
+    {
+        Trace::Scope trace ("Bounds");
+        while (reader.Read (block, READ_BLOCK)) {
+            for (Triangle const &t : block) {
+                for (Vec3 const &v : {t.v1, t.v2, t.v3}) {
+                    lo = Vec3 (std::min (lo.x, v.x), std::min (lo.y, v.y), std::min (lo.z, v.z));
+                    hi = Vec3 (std::max (hi.x, v.x), std::max (hi.y, v.y), std::max (hi.z, v.z));
+                }
+            }
+        }
+    }
+    Grid grid (lo, hi);
+
+    // Pass 2: faces per cell, cells are then grouped in z-order into buckets that fit the budget.
+    // Triangles spanning buckets are copied into each of them, leave room for those.
+    // A cell larger than a bucket is split into subcells, counted in one more pass, up to MAX_REFINE times.
+    size_t capacity = std::max<size_t> (1, memoryBudget / WORKING_BYTES_PER_FACE * 3 / 4);
+    std::vector<uint32_t> cellFaces;
+    auto histogram = [&reader, &block, &grid, &cellFaces] () {
+        Trace::Scope trace ("Histogram");
+        cellFaces.assign (grid.IdCount (), 0);
+        reader.Rewind ();
+        while (reader.Read (block, READ_BLOCK)) {
+            for (Triangle const &t : block) {
+                cellFaces[grid.Id (t.v1)]++;
+            }
+        }
+    };
+    histogram ();
+    for (size_t level = 0; level < MAX_REFINE && grid.Refine (cellFaces, capacity); ++level) {
+        histogram ();
+    }
+
+    std::vector<uint32_t> bucketOf (grid.IdCount ());
+    uint32_t bucketCount = 0;
+    size_t filled = 0;
+    std::vector<size_t> subOrder = ZOrder (SUB);
+    std::function<void (size_t)> assign = [&] (size_t id) {
+        if (grid.Refined (id)) {
+            for (size_t sub : subOrder) {
+                assign (grid.FirstSub (id) + sub);
+            }
+            return;
+        }
+        if (filled > 0 && filled + cellFaces[id] > capacity) {
+            bucketCount++;
+            filled = 0;
+        }
+        bucketOf[id] = bucketCount;
+        filled += cellFaces[id];
+    };
+    for (size_t cell : ZOrder (GRID)) {
+        assign (cell);
+    }
+    bucketCount++;
+    std::vector<uint32_t> ().swap (cellFaces);
+
+    // A triangle spans buckets if its vertices fall into different ones, or could once welded:
+    // a vertex within weldTolerance of another bucket counts as on the border
+    double tolerance = options.weldTolerance;
+    auto bucketsOf = [&grid, &bucketOf] (Triangle const &t) {
+        return std::array<uint32_t, 3>{bucketOf[grid.Id (t.v1)], bucketOf[grid.Id (t.v2)], bucketOf[grid.Id (t.v3)]};
+    };
+    auto onBorder = [&grid, &bucketOf, tolerance] (Vec3 const &v) {
+        uint32_t bucket = bucketOf[grid.Id (v)];
+        for (double dx : {-tolerance, tolerance}) {
+            for (double dy : {-tolerance, tolerance}) {
+                for (double dz : {-tolerance, tolerance}) {
+                    if (bucketOf[grid.Id (v + Vec3 (dx, dy, dz))] != bucket) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
+    auto spanning = [&bucketsOf, &onBorder] (Triangle const &t) {
+        std::array<uint32_t, 3> b = bucketsOf (t);
+        return b[0] != b[1] || b[0] != b[2] || onBorder (t.v1) || onBorder (t.v2) || onBorder (t.v3);
+    };
+
+    // Pass 3: distribute, MAX_OPEN_BUCKETS buckets per read of the input.
+    // Spanning triangles also go to the seam file, in the first read.
+    TempDirectory temp (fs::path (output).concat (".buckets"));
+    auto bucketPath = [&temp] (size_t b) { return temp.path / (std::to_string (b) + ".bin"); };
+    fs::path seamPath = temp.path / "seam.bin";
+    std::vector<size_t> bucketFaces (bucketCount, 0);
+    size_t pureFaces = 0, seamFaces = 0;
+    {
+        Trace::Scope trace ("Distribute");
+        std::ofstream seam (seamPath, std::ios::binary);
+        if (!seam.is_open ()) {
+            throw std::runtime_error ("Cannot create " + seamPath.string ());
+        }
+        for (size_t first = 0; first < bucketCount; first += MAX_OPEN_BUCKETS) {
+            size_t last = std::min<size_t> (bucketCount, first + MAX_OPEN_BUCKETS);
+            std::vector<std::ofstream> buckets;
+            buckets.reserve (last - first);
+            for (size_t b = first; b < last; ++b) {
+                buckets.emplace_back (bucketPath (b), std::ios::binary);
+                if (!buckets.back ().is_open ()) {
+                    throw std::runtime_error ("Cannot create bucket file " + bucketPath (b).string () + " with " +
+                                              std::to_string (buckets.size ()) + " bucket files open");
+                }
+            }
+
+            reader.Rewind ();
+            while (reader.Read (block, READ_BLOCK)) {
+                for (Triangle const &t : block) {
+                    std::array<uint32_t, 3> b = bucketsOf (t);
+                    for (size_t k = 0; k < 3; ++k) {
+                        if (first <= b[k] && b[k] < last && std::find (b.begin (), b.begin () + k, b[k]) == b.begin () + k) {
+                            WriteTriangle (buckets[b[k] - first], t);
+                            bucketFaces[b[k]]++;
+                        }
+                    }
+                    if (first > 0) {
+                        continue;
+                    }
+                    if (spanning (t)) {
+                        WriteTriangle (seam, t);
+                        seamFaces++;
+                    } else {
+                        pureFaces++;
+                    }
+                }
+            }
+            for (std::ofstream &file : buckets) {
+                if (!file) {
+                    throw std::runtime_error ("Error writing bucket in " + temp.path.string ());
+                }
+            }
+        }
+        if (!seam) {
+            throw std::runtime_error ("Error writing " + seamPath.string ());
+        }
+    }
+
+    // The seam pass loads every spanning triangle at once, fail before the buckets take their time
+    auto checkSeam = [seamFaces, memoryBudget] (size_t lockBytes) {
+        CheckMemoryLimit (seamFaces * WORKING_BYTES_PER_FACE + lockBytes, memoryBudget,
+                          "The seam pass of " + std::to_string (seamFaces) + " faces spanning buckets");
+    };
+    checkSeam (0);
+    // Subcells as dense as a whole bucket, e.g. many triangles on one spot, are not split further
+    auto checkBucket = [&bucketFaces, memoryBudget] (size_t b, size_t lockBytes) {
+        CheckMemoryLimit (bucketFaces[b] * WORKING_BYTES_PER_FACE + lockBytes, memoryBudget,
+                          "A bucket of " + std::to_string (bucketFaces[b]) + " faces in a region denser than the grid splits");
+    };
+    for (size_t b = 0; b < bucketCount; ++b) {
+        checkBucket (b, 0);
+    }
+
+    // The seam is barely reduced, the buckets make up for it
+    double target = reader.Count () * factor;
+    double bucketFactor = pureFaces ? std::clamp ((target - seamFaces) / pureFaces, 0.0, 1.0) : 0.0;
+
+    STL::BinaryWriter writer (output, options.threads);
+    SimplifyStats total;
+    size_t peakBytes = 0;
+    // Bucket results carry welded positions, the seam pass matches them with the same tolerance
+    VertexWelder lockWelder (tolerance);
+    for (size_t b = 0; b < bucketCount; ++b) {
+        if (bucketFaces[b] == 0) {
+            continue;
+        }
+        Trace::Scope trace ("Bucket");
+        checkBucket (b, lockWelder.Bytes ());
+        Mesh bucket = ReadTriangles (bucketPath (b), bucketFaces[b]);
+        fs::remove (bucketPath (b));
+
+        // Vertices of spanning triangles are frozen, the triangles themselves stay unchanged
+        std::vector<bool> locks (3 * bucket.size (), false);
+        size_t spanningFaces = 0;
+        for (size_t i = 0; i < bucket.size (); ++i) {
+            if (spanning (bucket[i])) {
+                locks[3 * i] = locks[3 * i + 1] = locks[3 * i + 2] = true;
+                spanningFaces++;
+            }
+        }
+
+        Simplifier simplifier (bucket, options, locks);
+        Mesh ().swap (bucket);
+        simplifier.Run (static_cast<size_t> ((bucketFaces[b] - spanningFaces) * bucketFactor) + spanningFaces);
+
+        // Spanning triangles are written by the seam pass, which must keep the frozen vertices still in use
+        Mesh result = simplifier.Result ();
+        std::vector<bool> lockedCorners = simplifier.LockedCorners ();
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size (); ++i) {
+            bool frozen = lockedCorners[3 * i] && lockedCorners[3 * i + 1] && lockedCorners[3 * i + 2];
+            if (frozen && spanning (result[i])) {
+                continue;
+            }
+            for (size_t k = 0; k < 3; ++k) {
+                if (lockedCorners[3 * i + k]) {
+                    lockWelder.Weld (k == 0 ? result[i].v1 : k == 1 ? result[i].v2 : result[i].v3);
+                }
+            }
+            result[kept++] = result[i];
+        }
+        result.resize (kept);
+        writer.Append (result);
+
+        SimplifyStats bucketStats = simplifier.Stats ();
+        peakBytes = std::max (peakBytes, bucketStats.arena.peakBytes);
+        Accumulate (total, bucketStats);
+    }
+
+    // Seam pass: the spanning triangles, with the vertices the buckets still use frozen
+    Trace::Scope seamTrace ("Seam");
+    checkSeam (lockWelder.Bytes ());
+    size_t lockCount = lockWelder.Positions ().size ();
+    Mesh seam = ReadTriangles (seamPath, seamFaces);
+    std::vector<bool> locks (3 * seam.size ());
+    for (size_t i = 0; i < seam.size (); ++i) {
+        locks[3 * i] = lockWelder.Weld (seam[i].v1) < lockCount;
+        locks[3 * i + 1] = lockWelder.Weld (seam[i].v2) < lockCount;
+        locks[3 * i + 2] = lockWelder.Weld (seam[i].v3) < lockCount;
+    }
+    Simplifier seamPass (seam, options, locks);
+    seamPass.Run (static_cast<size_t> (seam.size () * factor));
+    writer.Append (seamPass.Result ());
+    writer.Finish ();
+
+    if (stats) {
+        SimplifyStats seamStats = seamPass.Stats ();
+        peakBytes = std::max (peakBytes, seamStats.arena.peakBytes);
+        Accumulate (total, seamStats);
+        total.arena.peakBytes = peakBytes;
+        *stats = total;
+    }
+    return writer.Count ();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Simplify.hpp"
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+// Out-of-core simplification of a binary STL larger than memory. The triangles are
+// streamed into spatial buckets on disk, each sized to fit memoryBudget bytes, grid cells
+// denser than that are subdivided once. The buckets are simplified one at a time with the
+// vertices they share frozen. Triangles spanning buckets are simplified last, on their own.
+// The call throws before simplifying anything when a bucket or the seam still does not fit.
+// Returns the output face count.
+size_t SimplifyStreaming (fs::path const &input, fs::path const &output, double factor, size_t memoryBudget,
+                          SimplifyOptions const &options = {}, SimplifyStats *stats = nullptr);
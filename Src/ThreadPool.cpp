@@ -0,0 +1,93 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <utility>
+
+ThreadPool::ThreadPool (size_t threads) {
+    if (threads == 0) {
+        threads = std::max (1u, std::thread::hardware_concurrency ());
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back (&ThreadPool::Work, this);
+    }
+}
+
+ThreadPool::~ThreadPool () {
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        stopping = true;
+    }
+    wake.notify_all ();
+    for (std::thread &t : workers) {
+        t.join ();
+    }
+}
+
+void ThreadPool::ParallelFor (size_t count, std::function<void (size_t, size_t)> const &body, size_t minChunk) {
+    if (count == 0) {
+        return;
+    }
+    if (workers.empty () || count <= minChunk) {
+        body (0, count);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        job = &body;
+        jobCount = count;
+        // A few chunks per thread balances uneven chunks
+        jobChunk = std::max (minChunk, count / (Size () * 4) + 1);
+        nextChunk = 0;
+        failure = nullptr;
+        busy = workers.size ();
+        generation++;
+    }
+    wake.notify_all ();
+    RunChunks ();
+
+    std::unique_lock<std::mutex> lock (mutex);
+    done.wait (lock, [this] { return busy == 0; });
+    job = nullptr;
+    if (failure) {
+        std::rethrow_exception (std::exchange (failure, nullptr));
+    }
+}
+
+void ThreadPool::RunChunks () {
+    while (true) {
+        size_t begin = nextChunk.fetch_add (jobChunk);
+        if (begin >= jobCount) {
+            return;
+        }
+        try {
+            (*job) (begin, std::min (begin + jobChunk, jobCount));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (!failure) {
+                failure = std::current_exception ();
+            }
+            // Claim the chunks left so every thread stops after its current one
+            nextChunk = jobCount;
+        }
+    }
+}
+
+void ThreadPool::Work () {
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            wake.wait (lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        RunChunks ();
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            busy--;
+        }
+        done.notify_one ();
+    }
+}
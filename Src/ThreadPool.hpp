@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running one ParallelFor at a time.
+// The calling thread works on the chunks too; a pool of size 1 has no workers
+// and runs everything inline.
+class ThreadPool {
+  public:
+    // threads == 0 uses every hardware thread
+    explicit ThreadPool (size_t threads = 1);
+    ThreadPool (ThreadPool const &) = delete;
+    ThreadPool &operator= (ThreadPool const &) = delete;
+    ~ThreadPool ();
+
+    size_t Size () const { return workers.size () + 1; }
+
+    // Call body (begin, end) on chunks covering [0, count), returns when all chunks are done.
+    // The first exception a chunk throws is rethrown here once the others have finished,
+    // chunks not started yet are skipped.
+    void ParallelFor (size_t count, std::function<void (size_t, size_t)> const &body, size_t minChunk = 1024);
+
+  private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+    size_t generation = 0;
+    size_t busy = 0;
+
+    std::function<void (size_t, size_t)> const *job = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunk = 0;
+    std::atomic<size_t> nextChunk{0};
+    std::exception_ptr failure;
+
+    void Work ();
+    void RunChunks ();
+};
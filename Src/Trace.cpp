@@ -0,0 +1,112 @@
+#include "Trace.hpp"
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+bool Trace::enabled = false;
+
+namespace {
+struct Event {
+    char const *name;
+    char phase;
+    int64_t start;
+    int64_t duration;
+    uint32_t thread;
+    std::vector<std::pair<char const *, double>> series;
+};
+
+std::mutex mutex;
+std::vector<Event> events;
+int64_t origin = 0;
+uint32_t threadCount = 0;
+
+// Small stable id per thread, taken under the mutex
+uint32_t ThreadId () {
+    thread_local uint32_t id = UINT32_MAX;
+    if (id == UINT32_MAX) {
+        id = threadCount++;
+    }
+    return id;
+}
+
+void WriteMicroseconds (std::ofstream &file, int64_t nanoseconds) {
+    file << nanoseconds / 1000 << '.' << std::to_string (1000 + nanoseconds % 1000).substr (1);
+}
+}
+
+void Trace::Start () {
+    std::lock_guard<std::mutex> lock (mutex);
+    events.clear ();
+    origin = Now ();
+    enabled = true;
+}
+
+void Trace::Complete (char const *name, int64_t start, int64_t end) {
+    std::lock_guard<std::mutex> lock (mutex);
+    events.push_back ({name, 'X', start - origin, end - start, ThreadId (), {}});
+}
+
+void Trace::Scope::Begin () {
+    active = true;
+    if (enabled) {
+        start = Now ();
+    }
+    counted = PerfCounters::Counting ();
+    if (counted) {
+        counters = PerfCounters::Read ();
+    }
+}
+
+void Trace::Scope::End () {
+    if (counted) {
+        PerfCounters::Add (name, counters, PerfCounters::Read ());
+    }
+    if (enabled && start) {
+        Complete (name, start, Now ());
+    }
+}
+
+void Trace::Counter (char const *name, std::initializer_list<std::pair<char const *, double>> series) {
+    if (!enabled) {
+        return;
+    }
+    int64_t now = Now ();
+    std::lock_guard<std::mutex> lock (mutex);
+    events.push_back ({name, 'C', now - origin, 0, ThreadId (), series});
+}
+
+void Trace::Write (std::filesystem::path const &path) {
+    std::lock_guard<std::mutex> lock (mutex);
+    enabled = false;
+
+    std::ofstream file (path);
+    if (!file.is_open ()) {
+        throw std::runtime_error ("Cannot create trace file " + path.string ());
+    }
+    file.precision (15);
+    file << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+    for (size_t i = 0; i < events.size (); ++i) {
+        Event const &e = events[i];
+        file << (i ? ",\n" : "\n") << "{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase << "\", \"pid\": 1, \"tid\": " << e.thread << ", \"ts\": ";
+        WriteMicroseconds (file, e.start);
+        if (e.phase == 'X') {
+            file << ", \"dur\": ";
+            WriteMicroseconds (file, e.duration);
+        } else {
+            file << ", \"args\": {";
+            for (size_t s = 0; s < e.series.size (); ++s) {
+                file << (s ? ", " : "") << "\"" << e.series[s].first << "\": " << e.series[s].second;
+            }
+            file << "}";
+        }
+        file << "}";
+    }
+    file << "\n]}\n";
+    events.clear ();
+    if (!file) {
+        throw std::runtime_error ("Error writing trace file " + path.string ());
+    }
+}
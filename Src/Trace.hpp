@@ -0,0 +1,54 @@
+#pragma once
+#include "PerfCounters.hpp"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <utility>
+
+// Chrome / Perfetto trace events of the pipeline phases. Off until Start, a disabled
+// Scope or Counter costs a branch. Open the written file in chrome://tracing or ui.perfetto.dev.
+namespace Trace {
+extern bool enabled;
+
+inline bool Enabled () { return enabled; }
+inline int64_t Now () {
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+void Start ();
+// Writes the events recorded since Start and stops recording
+void Write (std::filesystem::path const &path);
+
+void Complete (char const *name, int64_t start, int64_t end);
+// Counter track name with one value per series
+void Counter (char const *name, std::initializer_list<std::pair<char const *, double>> series);
+
+// Records the lifetime of the scope as one event, name must outlive the trace.
+// The same scopes are the phases of the performance counter report
+class Scope {
+  public:
+    explicit Scope (char const *name) : name (name) {
+        if (enabled || PerfCounters::Started ()) {
+            Begin ();
+        }
+    }
+    ~Scope () {
+        if (active) {
+            End ();
+        }
+    }
+    Scope (Scope const &) = delete;
+    Scope &operator= (Scope const &) = delete;
+
+  private:
+    void Begin ();
+    void End ();
+
+    char const *name;
+    bool active = false;
+    bool counted = false;
+    int64_t start = 0;
+    PerfCounters::Sample counters;
+};
+}
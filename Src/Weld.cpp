@@ -0,0 +1,140 @@
+#include "Weld.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace {
+// Cells are a few tolerances wide so most points need no neighbor lookup
+constexpr double CELLS_PER_TOLERANCE = 16.0;
+
+size_t NextPowerOfTwo (size_t n) {
+    size_t p = 1024;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+}
+
+VertexWelder::VertexWelder (double tolerance, size_t expectedVertices)
+    : tolerance (tolerance),
+      cellSize (tolerance > 0 ? tolerance * CELLS_PER_TOLERANCE : 1.0),
+      slots (NextPowerOfTwo (2 * expectedVertices), Slot{EMPTY, 0}) {
+    positions.reserve (expectedVertices);
+}
+
+uint64_t VertexWelder::CellHash (int64_t x, int64_t y, int64_t z) const {
+    uint64_t h = static_cast<uint64_t> (x) * 0x9E3779B97F4A7C15ull;
+    h ^= static_cast<uint64_t> (y) * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t> (z) * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    return h ^ (h >> 29);
+}
+
+// Exact welding hashes the coordinate bits, -0 and +0 share a hash
+uint64_t VertexWelder::ExactHash (Vec3 const &v) const {
+    int64_t bits[3];
+    double coords[3] = {v.x + 0.0, v.y + 0.0, v.z + 0.0};
+    std::memcpy (bits, coords, sizeof (bits));
+    return CellHash (bits[0], bits[1], bits[2]);
+}
+
+uint64_t VertexWelder::Hash (Vec3 const &v) const {
+    if (tolerance <= 0) {
+        return ExactHash (v);
+    }
+    return CellHash (static_cast<int64_t> (std::floor (v.x / cellSize)),
+                     static_cast<int64_t> (std::floor (v.y / cellSize)),
+                     static_cast<int64_t> (std::floor (v.z / cellSize)));
+}
+
+bool VertexWelder::Near (Vec3 const &a, Vec3 const &b) const {
+    if (tolerance <= 0) {
+        return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+    return std::abs (a.x - b.x) < tolerance &&
+           std::abs (a.y - b.y) < tolerance &&
+           std::abs (a.z - b.z) < tolerance;
+}
+
+uint32_t VertexWelder::Find (uint64_t hash, Vec3 const &v) const {
+    size_t mask = slots.size () - 1;
+    uint32_t tag = static_cast<uint32_t> (hash >> 32);
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Slot const &s = slots[i];
+        if (s.vertex == EMPTY) {
+            return EMPTY;
+        }
+        if (s.tag == tag && Near (positions[s.vertex], v)) {
+            return s.vertex;
+        }
+    }
+}
+
+void VertexWelder::Insert (uint64_t hash, uint32_t vertex) {
+    size_t mask = slots.size () - 1;
+    size_t i = hash & mask;
+    while (slots[i].vertex != EMPTY) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = Slot{vertex, static_cast<uint32_t> (hash >> 32)};
+}
+
+void VertexWelder::Grow () {
+    std::vector<Slot> old (slots.size () * 2, Slot{EMPTY, 0});
+    old.swap (slots);
+    for (Slot const &s : old) {
+        if (s.vertex == EMPTY) {
+            continue;
+        }
+        Insert (Hash (positions[s.vertex]), s.vertex);
+    }
+}
+
+uint32_t VertexWelder::Weld (Vec3 const &v) {
+    if (tolerance <= 0) {
+        uint64_t hash = ExactHash (v);
+        uint32_t found = Find (hash, v);
+        return found != EMPTY ? found : Add (hash, v);
+    }
+
+    double fx = v.x / cellSize, fy = v.y / cellSize, fz = v.z / cellSize;
+    int64_t cx = static_cast<int64_t> (std::floor (fx));
+    int64_t cy = static_cast<int64_t> (std::floor (fy));
+    int64_t cz = static_cast<int64_t> (std::floor (fz));
+    uint64_t hash = CellHash (cx, cy, cz);
+
+    uint32_t found = Find (hash, v);
+    if (found != EMPTY) {
+        return found;
+    }
+
+    // Neighbor cells on the sides where the point is within tolerance of the border
+    double border = tolerance / cellSize;
+    int nx = fx - cx < border ? -1 : (cx + 1 - fx < border ? 1 : 0);
+    int ny = fy - cy < border ? -1 : (cy + 1 - fy < border ? 1 : 0);
+    int nz = fz - cz < border ? -1 : (cz + 1 - fz < border ? 1 : 0);
+    for (int i = 0; i <= (nx != 0); ++i) {
+        for (int j = 0; j <= (ny != 0); ++j) {
+            for (int k = 0; k <= (nz != 0); ++k) {
+                if (i + j + k == 0) {
+                    continue;
+                }
+                found = Find (CellHash (cx + i * nx, cy + j * ny, cz + k * nz), v);
+                if (found != EMPTY) {
+                    return found;
+                }
+            }
+        }
+    }
+
+    return Add (hash, v);
+}
+
+uint32_t VertexWelder::Add (uint64_t hash, Vec3 const &v) {
+    uint32_t vertex = static_cast<uint32_t> (positions.size ());
+    positions.push_back (v);
+    if (2 * positions.size () > slots.size ()) {
+        Grow ();
+    }
+    Insert (hash, vertex);
+    return vertex;
+}
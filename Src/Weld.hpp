@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Geometry.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Spatial hash welding: positions closer than the tolerance on every axis
+// (the Vec3::operator== rule) share one index. Points are hashed by grid cell,
+// neighbor cells are probed only when a point lies within tolerance of the cell border.
+class VertexWelder {
+  public:
+    explicit VertexWelder (double tolerance = EPSILON, size_t expectedVertices = 0);
+
+    uint32_t Weld (Vec3 const &v);
+    std::vector<Vec3> const &Positions () const { return positions; }
+    size_t Bytes () const { return slots.capacity () * sizeof (Slot) + positions.capacity () * sizeof (Vec3); }
+
+  private:
+    struct Slot {
+        uint32_t vertex;
+        uint32_t tag;
+    };
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    double tolerance;
+    double cellSize;
+    std::vector<Slot> slots;
+    std::vector<Vec3> positions;
+
+    uint64_t CellHash (int64_t x, int64_t y, int64_t z) const;
+    uint64_t ExactHash (Vec3 const &v) const;
+    uint64_t Hash (Vec3 const &v) const;
+    uint32_t Find (uint64_t hash, Vec3 const &v) const;
+    void Insert (uint64_t hash, uint32_t vertex);
+    uint32_t Add (uint64_t hash, Vec3 const &v);
+    void Grow ();
+    bool Near (Vec3 const &a, Vec3 const &b) const;
+};
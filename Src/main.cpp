@@ -1,6 +1,7 @@
 #include "SimplifierApp.hpp"
 
-#ifdef DEBUG
+// The leak check uses the Windows debug CRT
+#if defined(DEBUG) && defined(_WIN32)
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #include <iostream>
@@ -22,14 +23,15 @@ class MemoryLeakDetector {
 #endif
 
 int main (int argc, char *argv[]) {
-#ifdef DEBUG
+#if defined(DEBUG) && defined(_WIN32)
     MemoryLeakDetector memoryLeakDetector;
 #endif
 
     SimplifierApp app;
     if (app.Init (argc, argv)) {
         app.Run ();
+        return app.Failed () ? 1 : 0;
     }
-
-    return 0;
+    // Invalid or missing parameters, the usage was printed
+    return 1;
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "Simplifier.hpp"
+#include "TestMesh.hpp"
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <vector>
+
+// Replaces the global allocation functions of this program only, the library leaves them alone.
+// Counts the calls of the thread that set counting, other threads allocate uncounted.
+namespace {
+thread_local bool counting = false;
+thread_local size_t heapAllocations = 0;
+
+size_t HeapAllocationCount (std::function<void ()> const &f) {
+    heapAllocations = 0;
+    counting = true;
+    f ();
+    counting = false;
+    return heapAllocations;
+}
+}
+
+void *operator new (size_t size) {
+    if (counting) {
+        heapAllocations++;
+    }
+    if (void *p = std::malloc (size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc ();
+}
+
+void operator delete (void *p) noexcept {
+    std::free (p);
+}
+
+void operator delete (void *p, size_t) noexcept {
+    std::free (p);
+}
+
+int main () {
+    // The counter sees allocations made by this program
+    std::vector<int> probe;
+    if (HeapAllocationCount ([&probe] () { probe.resize (16); }) == 0) {
+        std::cerr << "FAILED: operator new is not counted" << std::endl;
+        return 1;
+    }
+
+    // Setup sizes the scratch buffers for the largest valence, the collapses reuse them
+    Mesh mesh = Sphere (100, 200);
+    Simplifier simplifier (mesh);
+    size_t allocations = HeapAllocationCount ([&simplifier, &mesh] () { simplifier.Run (mesh.size () / 10); });
+    if (allocations != 0 || simplifier.FaceCount () > mesh.size () / 10) {
+        std::cerr << "FAILED: " << mesh.size () << " -> " << simplifier.FaceCount () << " faces with " << allocations
+                  << " heap allocations in the collapse loop" << std::endl;
+        return 1;
+    }
+    return 0;
+}
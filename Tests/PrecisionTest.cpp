@@ -0,0 +1,42 @@
+#include "Extras.hpp"
+#include "STL.hpp"
+#include "Simplify.hpp"
+#include "TestMesh.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+// Built against the library in both precisions: "save" writes the result of one,
+// "compare" checks the result of the other against it
+int main (int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: PrecisionTest save|compare <path>" << std::endl;
+        return 1;
+    }
+    std::string command = argv[1];
+    fs::path path = argv[2];
+
+    // Far from the origin, where float coordinates are coarser than EPSILON
+    Mesh mesh = Sphere (150, 300, 500, Vec3 (1000, 2000, 3000));
+    Mesh result = Simplify (mesh, 0.1);
+    if (command == "save") {
+        STL::SaveBinary (path, result);
+        return 0;
+    }
+
+    MeshQuality quality = MeasureQuality (result);
+    MeshQuality reference = MeasureQuality (STL::Load (path));
+    auto deviation = [] (double value, double expected) {
+        return std::abs (value - expected) / std::max (std::abs (expected), EPSILON);
+    };
+    double area = deviation (quality.area, reference.area);
+    double volume = deviation (quality.volume, reference.volume);
+    std::cout << sizeof (Real) * 8 << " bit result: " << quality.faces << " faces, reference " << reference.faces << ", area "
+              << area * 100 << "%, volume " << volume * 100 << "% off" << std::endl;
+    if (area > 1e-3 || volume > 1e-3 || quality.faces > mesh.size () / 10) {
+        std::cerr << "FAILED: the precisions disagree by more than 0.1%" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "Geometry.hpp"
+#include <cmath>
+
+// Latitude-longitude sphere, its poles have a high valence
+inline Mesh Sphere (size_t rings, size_t segments, double radius = 1, Vec3 const &center = Vec3 ()) {
+    constexpr double PI = 3.14159265358979323846;
+    auto point = [=] (size_t r, size_t s) {
+        double theta = PI * r / rings, phi = 2 * PI * s / segments;
+        return center + Vec3 (radius * std::sin (theta) * std::cos (phi), radius * std::sin (theta) * std::sin (phi), radius * std::cos (theta));
+    };
+    Mesh mesh;
+    for (size_t r = 0; r < rings; ++r) {
+        for (size_t s = 0; s < segments; ++s) {
+            Vec3 a = point (r, s), b = point (r + 1, s), c = point (r + 1, s + 1), d = point (r, s + 1);
+            if (r > 0) {
+                mesh.emplace_back (a, b, d);
+            }
+            if (r + 1 < rings) {
+                mesh.emplace_back (b, c, d);
+            }
+        }
+    }
+    return mesh;
+}
@@ -0,0 +1,47 @@
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+int failures = 0;
+
+void Check (bool condition, char const *what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+}
+
+int main () {
+    for (size_t threads : {1, 4}) {
+        ThreadPool pool (threads);
+
+        // A throwing chunk reaches the caller, the pool stays usable
+        std::atomic<size_t> ran{0};
+        bool caught = false;
+        try {
+            pool.ParallelFor (1000, [&ran] (size_t begin, size_t end) {
+                ran += end - begin;
+                if (begin <= 500 && 500 < end) {
+                    throw std::runtime_error ("chunk 500");
+                }
+            }, 10);
+        } catch (std::runtime_error const &e) {
+            caught = std::string (e.what ()) == "chunk 500";
+        }
+        Check (caught, "exception rethrown from ParallelFor");
+        Check (ran <= 1000, "no chunk ran twice");
+
+        std::atomic<size_t> sum{0};
+        pool.ParallelFor (1000, [&sum] (size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                sum += i;
+            }
+        }, 10);
+        Check (sum == 999 * 1000 / 2, "every index visited after a failure");
+    }
+    return failures == 0 ? 0 : 1;
+}